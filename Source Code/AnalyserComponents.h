@@ -0,0 +1,259 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Scrolling spectrogram, fed from the GUI thread with samples pulled off an AudioTap.
+// Each hop of new audio is analysed once and drawn as one new column of the image;
+// columns already drawn are never touched again. The image is a ring: the newest
+// column overwrites the oldest, and paint() blits the two halves in order, so
+// scrolling moves no pixels in memory. Frequencies are on a log scale, 30 Hz to 20 kHz.
+class Spectrogram : public juce::Component
+{
+public:
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int hopSize = fftSize / 2;
+
+    explicit Spectrogram(juce::Colour colour)
+        : fft(fftOrder),
+          window(fftSize, juce::dsp::WindowingFunction<float>::hann, false)
+    {
+        setOpaque(true);
+        history.assign(fftSize, 0.0f);
+        fftData.assign(2 * fftSize, 0.0f);
+
+        // Silence in the background colour, rising through the colour to white
+        const juce::Colour background(20, 20, 24);
+        for (size_t i = 0; i < colourMap.size(); ++i)
+        {
+            const float level = (float)i / (float)(colourMap.size() - 1);
+            colourMap[i] = level < 0.6f ? background.interpolatedWith(colour, level / 0.6f)
+                                        : colour.interpolatedWith(juce::Colours::white, (level - 0.6f) / 0.4f);
+        }
+    }
+
+    void setSampleRate(double newSampleRate)
+    {
+        if (newSampleRate != sampleRate)
+        {
+            sampleRate = newSampleRate;
+            updateRowBins();
+        }
+    }
+
+    void pushSamples(const float* samples, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            history[(size_t)historyPos] = samples[i];
+            historyPos = (historyPos + 1) % fftSize;
+
+            if (++samplesSinceColumn == hopSize)
+            {
+                samplesSinceColumn = 0;
+                drawColumn();
+            }
+        }
+    }
+
+    // Once per timer tick, repaints if any columns were drawn
+    void update()
+    {
+        if (columnsDrawn)
+        {
+            columnsDrawn = false;
+            repaint();
+        }
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        if (! image.isValid())
+            return;
+
+        // Oldest columns first, then the ones that have wrapped around
+        const int width = image.getWidth();
+        const int height = image.getHeight();
+        g.drawImage(image, 0, 0, width - writeColumn, height, writeColumn, 0, width - writeColumn, height);
+        if (writeColumn > 0)
+            g.drawImage(image, width - writeColumn, 0, writeColumn, height, 0, 0, writeColumn, height);
+    }
+
+    void resized() override
+    {
+        image = juce::Image(juce::Image::RGB, juce::jmax(1, getWidth()), juce::jmax(1, getHeight()), false);
+        image.clear(image.getBounds(), colourMap[0]);
+        writeColumn = 0;
+        updateRowBins();
+    }
+
+private:
+    static constexpr float minFrequency = 30.0f;
+    static constexpr float maxFrequency = 20000.0f;
+    static constexpr float floorDb = -100.0f;
+
+    // The bins each row of pixels covers, at least one
+    void updateRowBins()
+    {
+        const int height = juce::jmax(1, getHeight());
+        const float topFrequency = juce::jmin(maxFrequency, (float)sampleRate * 0.5f);
+        const float binWidth = (float)sampleRate / fftSize;
+        rowBins.resize((size_t)height);
+
+        auto frequencyAt = [&](float y)
+        {
+            return minFrequency * std::pow(topFrequency / minFrequency, 1.0f - y / (float)height);
+        };
+
+        for (int y = 0; y < height; ++y)
+        {
+            const int first = juce::jlimit(1, fftSize / 2, (int)(frequencyAt((float)y + 1.0f) / binWidth));
+            const int last = juce::jlimit(first, fftSize / 2, (int)(frequencyAt((float)y) / binWidth));
+            rowBins[(size_t)y] = { first, last };
+        }
+    }
+
+    void drawColumn()
+    {
+        if (! image.isValid())
+            return;
+
+        // The last fftSize samples, oldest first
+        std::copy(history.begin() + historyPos, history.end(), fftData.begin());
+        std::copy(history.begin(), history.begin() + historyPos, fftData.begin() + (fftSize - historyPos));
+        window.multiplyWithWindowingTable(fftData.data(), fftSize);
+        fft.performFrequencyOnlyForwardTransform(fftData.data());
+
+        // A full-scale sine comes out at fftSize / 4 through the Hann window
+        const float scale = 4.0f / fftSize;
+        juce::Image::BitmapData pixels(image, writeColumn, 0, 1, image.getHeight(), juce::Image::BitmapData::writeOnly);
+
+        for (int y = 0; y < image.getHeight(); ++y)
+        {
+            const auto [first, last] = rowBins[(size_t)y];
+            float magnitude = 0.0f;
+            for (int bin = first; bin <= last; ++bin)
+                magnitude = juce::jmax(magnitude, fftData[(size_t)bin]);
+
+            const float db = juce::Decibels::gainToDecibels(magnitude * scale, floorDb);
+            const int index = juce::jlimit(0, (int)colourMap.size() - 1, (int)((1.0f - db / floorDb) * (float)(colourMap.size() - 1)));
+            pixels.setPixelColour(0, y, colourMap[(size_t)index]);
+        }
+
+        writeColumn = (writeColumn + 1) % image.getWidth();
+        columnsDrawn = true;
+    }
+
+    juce::dsp::FFT fft;
+    juce::dsp::WindowingFunction<float> window;
+    std::vector<float> history;
+    std::vector<float> fftData;
+    int historyPos = 0;
+    int samplesSinceColumn = 0;
+
+    double sampleRate = 44100.0;
+    std::vector<std::pair<int, int>> rowBins;
+    std::array<juce::Colour, 256> colourMap;
+
+    juce::Image image;
+    int writeColumn = 0;
+    bool columnsDrawn = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Spectrogram)
+};
+
+//==============================================================================
+// Peak and RMS bars for two channels, -60 to 0 dBFS. Levels are gathered from the
+// samples pulled each timer tick; the peak falls back slowly in between. Only
+// repaints when a bar has moved by a visible amount.
+class LevelMeter : public juce::Component
+{
+public:
+    explicit LevelMeter(juce::Colour colour) : barColour(colour)
+    {
+        setOpaque(true);
+    }
+
+    void addSamples(const float* left, const float* right, int numSamples)
+    {
+        const std::array<const float*, 2> channels { left, right };
+
+        for (size_t c = 0; c < channels.size(); ++c)
+        {
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float x = channels[c][i];
+                pendingPeak[c] = juce::jmax(pendingPeak[c], std::abs(x));
+                pendingSquares[c] += x * x;
+            }
+        }
+
+        pendingSamples += numSamples;
+    }
+
+    // Once per timer tick
+    void update()
+    {
+        bool changed = false;
+
+        for (size_t c = 0; c < peak.size(); ++c)
+        {
+            const float newPeak = juce::jmax(pendingPeak[c], peak[c] * peakFallPerTick);
+            const float newRms = pendingSamples > 0 ? std::sqrt(pendingSquares[c] / (float)pendingSamples)
+                                                    : rms[c] * peakFallPerTick;
+
+            changed = changed || std::abs(toDisplay(newPeak) - toDisplay(paintedPeak[c])) > 0.005f
+                              || std::abs(toDisplay(newRms) - toDisplay(paintedRms[c])) > 0.005f;
+            peak[c] = newPeak;
+            rms[c] = newRms;
+        }
+
+        pendingPeak.fill(0.0f);
+        pendingSquares.fill(0.0f);
+        pendingSamples = 0;
+
+        if (changed)
+            repaint();
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        g.fillAll(juce::Colour(20, 20, 24));
+        paintedPeak = peak;
+        paintedRms = rms;
+
+        const float barWidth = (float)getWidth() / (float)peak.size();
+        const float height = (float)getHeight();
+
+        for (size_t c = 0; c < peak.size(); ++c)
+        {
+            const float x = barWidth * (float)c + 1.0f;
+            const float rmsTop = height * (1.0f - toDisplay(rms[c]));
+            const float peakTop = height * (1.0f - toDisplay(peak[c]));
+
+            g.setColour(barColour);
+            g.fillRect(x, rmsTop, barWidth - 2.0f, height - rmsTop);
+
+            g.setColour(peak[c] >= 1.0f ? juce::Colours::red : juce::Colours::white);
+            g.fillRect(x, peakTop, barWidth - 2.0f, 2.0f);
+        }
+    }
+
+private:
+    static constexpr float rangeDb = 60.0f;
+    static constexpr float peakFallPerTick = 0.9f;    // about 27 dB/s at 30 Hz
+
+    // 0 at the bottom of the scale, 1 at full scale
+    static float toDisplay(float gain)
+    {
+        return juce::jlimit(0.0f, 1.0f, 1.0f + juce::Decibels::gainToDecibels(gain, -rangeDb) / rangeDb);
+    }
+
+    juce::Colour barColour;
+    std::array<float, 2> peak {}, rms {};
+    std::array<float, 2> paintedPeak {}, paintedRms {};
+    std::array<float, 2> pendingPeak {}, pendingSquares {};
+    int pendingSamples = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LevelMeter)
+};
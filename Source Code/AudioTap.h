@@ -0,0 +1,77 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Hands copies of the audio to the editor for its meters and spectrograms.
+// A single-producer, single-consumer FIFO: the audio thread pushes and one GUI
+// thread pulls, neither ever locks, and the storage is allocated once up front.
+// When the FIFO is full the newest audio is dropped rather than waiting for the
+// reader. Nothing is pushed while no reader is attached, so a closed editor costs
+// one relaxed load per block.
+class AudioTap {
+public:
+    static constexpr int numChannels = 2;     // mono input is pushed to both
+    static constexpr int capacity = 1 << 15;  // samples per channel, 170 ms at 192 kHz
+
+    AudioTap() : fifo(capacity) {
+        for (auto& channel : channels)
+            channel.assign((size_t) capacity, 0.0f);
+    }
+
+    // Not called while audio is running
+    void prepare(double newSampleRate) {
+        sampleRate.store(newSampleRate, std::memory_order_relaxed);
+    }
+
+    double getSampleRate() const {
+        return sampleRate.load(std::memory_order_relaxed);
+    }
+
+    // Audio thread
+    void push(const juce::AudioBuffer<float>& buffer) {
+        if (! attached.load(std::memory_order_relaxed) || buffer.getNumChannels() <= 0)
+            return;
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(buffer.getNumSamples(), start1, size1, start2, size2);
+
+        for (int c = 0; c < numChannels; ++c) {
+            const float* data = buffer.getReadPointer(juce::jmin(c, buffer.getNumChannels() - 1));
+            std::copy(data, data + size1, channels[(size_t) c].begin() + start1);
+            std::copy(data + size1, data + size1 + size2, channels[(size_t) c].begin() + start2);
+        }
+
+        fifo.finishedWrite(size1 + size2);
+    }
+
+    // Reader thread. Anything left over from the last reader is thrown away.
+    void attachReader() {
+        fifo.finishedRead(fifo.getNumReady());
+        attached.store(true, std::memory_order_relaxed);
+    }
+
+    void detachReader() {
+        attached.store(false, std::memory_order_relaxed);
+    }
+
+    // Reader thread. Copies up to maxSamples per channel and returns how many.
+    int pull(std::array<float*, numChannels> destination, int maxSamples) {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(maxSamples, start1, size1, start2, size2);
+
+        for (int c = 0; c < numChannels; ++c) {
+            const float* data = channels[(size_t) c].data();
+            std::copy(data + start1, data + start1 + size1, destination[(size_t) c]);
+            std::copy(data + start2, data + start2 + size2, destination[(size_t) c] + size1);
+        }
+
+        fifo.finishedRead(size1 + size2);
+        return size1 + size2;
+    }
+
+private:
+    juce::AbstractFifo fifo;
+    std::array<std::vector<float>, numChannels> channels;
+    std::atomic<bool> attached { false };
+    std::atomic<double> sampleRate { 44100.0 };
+};
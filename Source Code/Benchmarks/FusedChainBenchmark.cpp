@@ -0,0 +1,182 @@
+// Compares the fused per-sample stages with running them as separate passes.
+// Built by the FusedChainBenchmark target in CMakeLists.txt; run a Release build.
+// Both paths render 32-sample slices, as processBlock does. The multi-pass path
+// loops over each slice once per stage: input gain, low cut, tone, distortion and
+// output gain. The fused path uses the template kernels, which run the filters
+// with the channels side by side in SIMD lanes. Both produce the same output,
+// which is checked before timing.
+
+#include <JuceHeader.h>
+#include "../ChainStages.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+    constexpr int blockSize = 512;
+    constexpr int sliceSize = 32;
+    constexpr int numChannels = 2;
+    constexpr int numBlocks = 200000;
+    constexpr float sampleRate = 44100.0f;
+
+    struct Settings
+    {
+        const char* name;
+        float lowCut;
+        float tone;
+        float distortion;
+    };
+
+    void fillBlock(juce::AudioBuffer<float>& buffer, juce::Random& random)
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            for (int i = 0; i < blockSize; ++i)
+                buffer.setSample(channel, i, random.nextFloat() * 0.5f - 0.25f);
+    }
+
+    float filter(ChainStages::Svf& svf, int channel, float x, const ChainStages::Svf::Coefficients& coefficients)
+    {
+        return ChainStages::Svf::process(svf.ic1[(size_t)channel], svf.ic2[(size_t)channel], x, coefficients);
+    }
+
+    // One loop over each slice per stage, one channel at a time
+    void renderMultiPass(ChainStages::State& state, juce::AudioBuffer<float>& buffer, const Settings& settings)
+    {
+        const auto lowCut = ChainStages::LowCut::getCoefficients(settings.lowCut, sampleRate);
+        const auto tone = ChainStages::Tone::getCoefficients(settings.tone, sampleRate);
+
+        for (int start = 0; start < blockSize; start += sliceSize)
+        {
+            auto pass = [&buffer, start](auto&& process)
+            {
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    float* data = buffer.getWritePointer(channel, start);
+                    for (int i = 0; i < sliceSize; ++i)
+                        data[i] = process(channel, data[i]);
+                }
+            };
+
+            pass([](int, float x) { return x * 0.9f; });
+
+            if (! ChainStages::LowCut::isBypassed(settings.lowCut))
+                pass([&](int channel, float x) { return filter(state.lowCut.filter, channel, x, lowCut); });
+
+            if (! ChainStages::Tone::isBypassed(settings.tone))
+                pass([&](int channel, float x) { return filter(state.tone.filter, channel, x, tone); });
+
+            if (! ChainStages::Distortion::isBypassed(settings.distortion))
+                pass([&](int, float x) { return ChainStages::Distortion::process(x, settings.distortion); });
+
+            pass([](int, float x) { return x * 1.0f; });
+        }
+    }
+
+    // Both fused sections per slice, as processControlBlock runs them
+    void renderFused(ChainStages::State& state, ChainStages::Controls<sliceSize>& controls,
+                     juce::AudioBuffer<float>& buffer, const Settings& settings)
+    {
+        juce::SmoothedValue<float> inputGain(0.9f), lowCut(settings.lowCut), tone(settings.tone),
+                                   distortion(settings.distortion), outputGain(1.0f);
+
+        for (int start = 0; start < blockSize; start += sliceSize)
+        {
+            juce::AudioBuffer<float> slice(buffer.getArrayOfWritePointers(), numChannels, start, sliceSize);
+
+            controls.inputGain.fill(inputGain, sliceSize);
+            controls.lowCut.fill(lowCut, sliceSize, ChainStages::LowCut::getCoefficients);
+            controls.tone.fill(tone, sliceSize, ChainStages::Tone::getCoefficients);
+            controls.distortion.fill(distortion, sliceSize);
+            controls.outputGain.fill(outputGain, sliceSize);
+
+            ChainStages::renderInputStages(state, slice, controls, ! ChainStages::LowCut::isBypassed(settings.lowCut));
+            ChainStages::renderOutputStages(state, slice, controls,
+                                            ! ChainStages::Tone::isBypassed(settings.tone),
+                                            ChainStages::Distortion::isBypassed(settings.distortion)
+                                                ? ChainStages::DistortionMode::off
+                                                : ChainStages::DistortionMode::plain);
+        }
+    }
+
+    template <typename Render>
+    double timeRender(Render&& render)
+    {
+        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+        juce::Random random(7);
+        std::chrono::nanoseconds elapsed { 0 };
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            fillBlock(buffer, random);
+            const auto start = std::chrono::steady_clock::now();
+            render(buffer);
+            elapsed += std::chrono::steady_clock::now() - start;
+        }
+
+        return (double)elapsed.count() / ((double)numBlocks * blockSize);
+    }
+
+    float maxDifference(const Settings& settings)
+    {
+        ChainStages::State multiState, fusedState;
+        ChainStages::Controls<sliceSize> controls;
+        controls.prepare(sampleRate);
+        juce::AudioBuffer<float> multi(numChannels, blockSize), fused(numChannels, blockSize);
+        juce::Random random(3);
+        float difference = 0.0f;
+
+        for (int block = 0; block < 16; ++block)
+        {
+            fillBlock(multi, random);
+            fused.makeCopyOf(multi);
+
+            renderMultiPass(multiState, multi, settings);
+            renderFused(fusedState, controls, fused, settings);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int i = 0; i < blockSize; ++i)
+                    difference = juce::jmax(difference, std::abs(multi.getSample(channel, i) - fused.getSample(channel, i)));
+        }
+
+        return difference;
+    }
+}
+
+int main()
+{
+    const Settings settings[] = {
+        { "neutral",         20.0f,  0.5f, 0.0f },
+        { "low cut",        200.0f,  0.5f, 0.0f },
+        { "tone",            20.0f,  0.8f, 0.0f },
+        { "distortion",      20.0f,  0.5f, 0.4f },
+        { "all stages",     200.0f,  0.8f, 0.4f },
+    };
+
+    std::printf("%d-sample blocks, %d-sample slices, %d channels\n", blockSize, sliceSize, numChannels);
+    std::printf("%-12s %8s %14s %14s %10s %12s\n", "stages", "passes", "multi ns/smp", "fused ns/smp", "speedup", "max diff");
+
+    for (const auto& setting : settings)
+    {
+        const bool useTone = ! ChainStages::Tone::isBypassed(setting.tone);
+        int passes = 2;
+        passes += ChainStages::LowCut::isBypassed(setting.lowCut) ? 0 : 1;
+        passes += useTone ? 1 : 0;
+        passes += ChainStages::Distortion::isBypassed(setting.distortion) ? 0 : 1;
+
+        // The tone runs across the channels in its own pass ahead of distortion and gain
+        const int fusedPasses = useTone ? 3 : 2;
+
+        ChainStages::State multiState, fusedState;
+        ChainStages::Controls<sliceSize> controls;
+        controls.prepare(sampleRate);
+
+        const double multi = timeRender([&](juce::AudioBuffer<float>& buffer) { renderMultiPass(multiState, buffer, setting); });
+        const double fused = timeRender([&](juce::AudioBuffer<float>& buffer) { renderFused(fusedState, controls, buffer, setting); });
+
+        std::printf("%-12s %4d -> %d %14.3f %14.3f %9.2fx %12.2e\n",
+                    setting.name, passes, fusedPasses, multi, fused, multi / fused, maxDifference(setting));
+    }
+
+    return 0;
+}
@@ -0,0 +1,449 @@
+// Times each stage of the processing chain on its own and the chain as a whole,
+// across block sizes, sample rates, channel counts and characters, and writes the
+// results as JSON so runs from different releases can be compared.
+// Built by the StageBenchmark target in CMakeLists.txt; run a Release build.
+//
+//     StageBenchmark [results.json]      (default: stdout, progress goes to stderr)
+//
+// Every stage is timed directly on its own, over control-rate slices where the
+// engine uses them: the per-sample stages, the pitch tracker, the PSOLA, formant and
+// voice stages of the low latency path, and the reverbs. Only the preset blend lives
+// inside the engine, so it is timed through processBlock with everything else neutral
+// and reported as the difference from the neutral chain. Input is noise, so no stage
+// is ever skipped as idle, except for the tracker and PSOLA shifter, which get a
+// voiced signal so they take the path a voice does. Every figure is per sample frame,
+// whatever the channel count.
+
+#include <JuceHeader.h>
+#include "../PluginProcessor.h"
+#include "../ChainStages.h"
+#include "../ConvolutionReverb.h"
+#include "../FdnReverb.h"
+#include "../PitchTracker.h"
+
+#include <chrono>
+#include <cstdio>
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+namespace
+{
+    constexpr int blockSizes[] = { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    constexpr double sampleRates[] = { 44100.0, 48000.0, 96000.0, 192000.0 };
+    constexpr int channelCounts[] = { 1, 2 };
+    constexpr double secondsPerCase = 0.5;
+    constexpr double warmUpSeconds = 0.1;
+    constexpr int sliceSize = 32;
+
+    struct Config
+    {
+        double sampleRate;
+        int blockSize;
+        int numChannels;
+    };
+
+    struct Timing
+    {
+        double nsPerSample = 0.0;
+        double cyclesPerSample = 0.0;
+    };
+
+    // Time stamp counter, which ticks at the nominal clock rate on current x86 CPUs.
+    // Elsewhere there is no portable equivalent and cycles are left out.
+   #if JUCE_INTEL
+    constexpr bool hasCycleCounter = true;
+    inline std::uint64_t readCycleCounter() { return (std::uint64_t)__rdtsc(); }
+   #else
+    constexpr bool hasCycleCounter = false;
+    inline std::uint64_t readCycleCounter() { return 0; }
+   #endif
+
+    void fillBlock(juce::AudioBuffer<float>& buffer, juce::Random& random)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample(channel, i, random.nextFloat() * 0.5f - 0.25f);
+    }
+
+    // Harmonic-rich 150 Hz tone with a slow vibrato, which the tracker reads as voiced
+    struct VoicedSignal
+    {
+        static constexpr float frequency = 150.0f;
+
+        double phase = 0.0;
+        double vibratoPhase = 0.0;
+
+        void fill(juce::AudioBuffer<float>& buffer, double sampleRate)
+        {
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+            {
+                float sample = 0.0f;
+                for (int harmonic = 1; harmonic <= 8; ++harmonic)
+                    sample += 0.2f * std::sin((float)(harmonic * phase)) / (float)harmonic;
+
+                for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+                    buffer.setSample(channel, i, sample);
+
+                vibratoPhase += juce::MathConstants<double>::twoPi * 5.0 / sampleRate;
+                phase += juce::MathConstants<double>::twoPi * frequency * (1.0 + 0.01 * std::sin(vibratoPhase)) / sampleRate;
+            }
+
+            phase = std::fmod(phase, juce::MathConstants<double>::twoPi);
+            vibratoPhase = std::fmod(vibratoPhase, juce::MathConstants<double>::twoPi);
+        }
+    };
+
+    // Runs `render` on blocks that `fill` writes, timing only the calls themselves
+    template <typename Render, typename Fill>
+    Timing timeBlocks(const Config& config, Render&& render, Fill&& fill)
+    {
+        juce::AudioBuffer<float> buffer(config.numChannels, config.blockSize);
+        juce::Random random(42);
+
+        const int numBlocks = juce::jmax(4, (int)(secondsPerCase * config.sampleRate / config.blockSize));
+        const int numWarmUpBlocks = juce::jmax(4, (int)(warmUpSeconds * config.sampleRate / config.blockSize));
+
+        for (int block = 0; block < numWarmUpBlocks; ++block)
+        {
+            fill(buffer, random);
+            render(buffer);
+        }
+
+        std::chrono::nanoseconds elapsed { 0 };
+        std::uint64_t cycles = 0;
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            fill(buffer, random);
+            const auto start = std::chrono::steady_clock::now();
+            const auto startCycles = readCycleCounter();
+            render(buffer);
+            cycles += readCycleCounter() - startCycles;
+            elapsed += std::chrono::steady_clock::now() - start;
+        }
+
+        const double numSamples = (double)numBlocks * config.blockSize;
+        return { (double)elapsed.count() / numSamples, (double)cycles / numSamples };
+    }
+
+    // On noise
+    template <typename Render>
+    Timing timeBlocks(const Config& config, Render&& render)
+    {
+        return timeBlocks(config, std::forward<Render>(render), fillBlock);
+    }
+
+    template <typename Render>
+    Timing timeVoicedBlocks(const Config& config, Render&& render)
+    {
+        VoicedSignal signal;
+        return timeBlocks(config, std::forward<Render>(render),
+                          [&](juce::AudioBuffer<float>& buffer, juce::Random&) { signal.fill(buffer, config.sampleRate); });
+    }
+
+    // Renders a block in control-rate slices, as the engine does
+    template <typename RenderSlice>
+    void forEachSlice(juce::AudioBuffer<float>& buffer, RenderSlice&& renderSlice)
+    {
+        for (int start = 0; start < buffer.getNumSamples(); start += sliceSize)
+        {
+            const int numSamples = juce::jmin(sliceSize, buffer.getNumSamples() - start);
+            juce::AudioBuffer<float> slice(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, numSamples);
+            renderSlice(slice);
+        }
+    }
+
+    //==============================================================================
+    // Fused per-sample stages, a slice at a time with freshly filled controls
+    struct ChainStageSettings
+    {
+        float lowCut = 20.0f;
+        float tone = 0.5f;
+        float distortion = 0.0f;
+    };
+
+    Timing timeChainStages(const Config& config, const ChainStageSettings& settings)
+    {
+        ChainStages::State state;
+        ChainStages::Controls<sliceSize> controls;
+        ChainStages::OversampledDistortion<sliceSize> oversampled;
+        controls.prepare(config.sampleRate);
+        oversampled.prepare(config.numChannels);
+
+        juce::SmoothedValue<float> gain(1.0f), distortion(settings.distortion);
+        juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> lowCut(settings.lowCut);
+        juce::SmoothedValue<float> tone(settings.tone);
+
+        const bool useLowCut = ! ChainStages::LowCut::isBypassed(settings.lowCut);
+        const bool useTone = ! ChainStages::Tone::isBypassed(settings.tone);
+        const bool useDistortion = ! ChainStages::Distortion::isBypassed(settings.distortion);
+
+        return timeBlocks(config, [&](juce::AudioBuffer<float>& buffer)
+        {
+            for (int start = 0; start < config.blockSize; start += sliceSize)
+            {
+                const int numSamples = juce::jmin(sliceSize, config.blockSize - start);
+                juce::AudioBuffer<float> slice(buffer.getArrayOfWritePointers(), config.numChannels, start, numSamples);
+
+                controls.inputGain.fill(gain, numSamples);
+                controls.lowCut.fill(lowCut, numSamples, ChainStages::LowCut::getCoefficients);
+                controls.tone.fill(tone, numSamples, ChainStages::Tone::getCoefficients);
+                controls.distortion.fill(distortion, numSamples);
+                controls.outputGain.fill(gain, numSamples);
+
+                if (useLowCut)
+                    ChainStages::renderInputStages(state, slice, controls, true);
+
+                // Distortion as the defaults run it: 2x oversampled and antialiased
+                if (useDistortion)
+                    ChainStages::renderOversampledOutputStages(state, slice, controls, oversampled, useTone,
+                                                               ChainStages::DistortionMode::antialiased, 1);
+                else if (useTone)
+                    ChainStages::renderOutputStages(state, slice, controls, true, ChainStages::DistortionMode::off);
+            }
+        });
+    }
+
+    Timing timeFdnReverb(const Config& config)
+    {
+        FdnReverb reverb;
+        reverb.setMix(0.3f, 0.85f);
+        reverb.prepare({ config.sampleRate, (juce::uint32)config.blockSize, (juce::uint32)config.numChannels });
+
+        return timeBlocks(config, [&](juce::AudioBuffer<float>& buffer) { reverb.process(buffer); });
+    }
+
+    // The longest built-in room, at the default head size
+    Timing timeConvolutionReverb(const Config& config)
+    {
+        ConvolutionReverb reverb;
+        reverb.setRoom(ConvolutionReverb::cathedral);
+        reverb.setMix(0.3f, 0.85f);
+        reverb.prepare({ config.sampleRate, (juce::uint32)config.blockSize, (juce::uint32)config.numChannels });
+        reverb.waitUntilReady(30000);
+
+        return timeBlocks(config, [&](juce::AudioBuffer<float>& buffer) { reverb.process(buffer); });
+    }
+
+    //==============================================================================
+    // The low latency path's stages, set up as the engine's Broadcast profile does
+    constexpr float lowestPitch = 80.0f;
+
+    juce::dsp::ProcessSpec getSliceSpec(const Config& config)
+    {
+        return { config.sampleRate, (juce::uint32)sliceSize, (juce::uint32)config.numChannels };
+    }
+
+    Timing timePitchTracker(const Config& config)
+    {
+        PitchTracker tracker;
+        tracker.setFrequencyRange(lowestPitch * 0.75f, 1000.0f);
+        tracker.prepare(getSliceSpec(config));
+
+        return timeVoicedBlocks(config, [&](juce::AudioBuffer<float>& buffer)
+        {
+            forEachSlice(buffer, [&](juce::AudioBuffer<float>& slice) { tracker.process(slice); });
+        });
+    }
+
+    // Given the input's period, as the tracker would report it
+    Timing timePitchShifter(const Config& config, float semitones)
+    {
+        VocalTransformerEngine::SimpleShifter shifter;
+        shifter.setLowestPitch(lowestPitch);
+        shifter.prepare(getSliceSpec(config));
+        shifter.setVoiced(true);
+        shifter.setPitchPeriod((float)config.sampleRate / VoicedSignal::frequency);
+        shifter.setPitchRatio(std::pow(2.0f, semitones / 12.0f));
+
+        return timeVoicedBlocks(config, [&](juce::AudioBuffer<float>& buffer)
+        {
+            forEachSlice(buffer, [&](juce::AudioBuffer<float>& slice) { shifter.processBlock(slice); });
+        });
+    }
+
+    Timing timeFormantShifter(const Config& config, float shift)
+    {
+        VocalTransformerEngine::SimpleFormantShifter shifter;
+        shifter.prepare(getSliceSpec(config));
+        shifter.setFormantShift(shift);
+
+        return timeBlocks(config, [&](juce::AudioBuffer<float>& buffer)
+        {
+            forEachSlice(buffer, [&](juce::AudioBuffer<float>& slice) { shifter.processBlock(slice); });
+        });
+    }
+
+    Timing timeVoiceMultiplier(const Config& config, int voiceCount, float detune)
+    {
+        VocalTransformerEngine::SimpleVoiceMultiplier multiplier;
+        multiplier.prepare(getSliceSpec(config));
+        multiplier.setVoiceCount(voiceCount);
+        multiplier.setDetune(detune);
+
+        return timeBlocks(config, [&](juce::AudioBuffer<float>& buffer)
+        {
+            forEachSlice(buffer, [&](juce::AudioBuffer<float>& slice) { multiplier.processBlock(slice); });
+        });
+    }
+
+    //==============================================================================
+    // The preset blend, the chain and the characters, timed through processBlock
+    void setParameter(VocalTransformerAudioProcessor& processor, const juce::String& id, float value)
+    {
+        auto* parameter = processor.parameters.getParameter(id);
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    }
+
+    void setNeutral(VocalTransformerAudioProcessor& processor)
+    {
+        setParameter(processor, "character", (float)NORMAL);
+        setParameter(processor, "character_strength", 1.0f);
+        setParameter(processor, "pitch_shift", 0.0f);
+        setParameter(processor, "formant_shift", 0.5f);
+        setParameter(processor, "voice_count", 1.0f);
+        setParameter(processor, "detune", 0.0f);
+        setParameter(processor, "reverb", 0.0f);
+        setParameter(processor, "distortion", 0.0f);
+        setParameter(processor, "low_cut", 20.0f);
+        setParameter(processor, "tone", 0.5f);
+    }
+
+    // Starts from the neutral settings, `configure` then switches on what is measured
+    template <typename Configure>
+    Timing timeProcessor(VocalTransformerAudioProcessor& processor, const Config& config, Configure&& configure)
+    {
+        setNeutral(processor);
+        configure(processor);
+
+        processor.setPlayConfigDetails(config.numChannels, config.numChannels, config.sampleRate, config.blockSize);
+        processor.prepareToPlay(config.sampleRate, config.blockSize);
+        processor.waitUntilReady(30000);
+
+        juce::MidiBuffer midi;
+        const auto timing = timeBlocks(config, [&](juce::AudioBuffer<float>& buffer) { processor.processBlock(buffer, midi); });
+
+        processor.releaseResources();
+        return timing;
+    }
+
+    Timing operator-(const Timing& a, const Timing& b)
+    {
+        return { a.nsPerSample - b.nsPerSample, a.cyclesPerSample - b.cyclesPerSample };
+    }
+
+    //==============================================================================
+    void writeResult(std::FILE* out, bool& first, const Config& config, const char* stage,
+                     const juce::String& character, bool marginal, const Timing& timing)
+    {
+        const double realtimeFactor = 1.0e9 / (juce::jmax(1.0e-6, timing.nsPerSample) * config.sampleRate);
+
+        std::fprintf(out, "%s\n    { \"stage\": \"%s\", ", first ? "" : ",", stage);
+        if (character.isNotEmpty())
+            std::fprintf(out, "\"character\": \"%s\", ", character.toRawUTF8());
+
+        std::fprintf(out, "\"sampleRate\": %.0f, \"blockSize\": %d, \"channels\": %d, \"marginal\": %s, "
+                          "\"nsPerSample\": %.4f, ",
+                     config.sampleRate, config.blockSize, config.numChannels, marginal ? "true" : "false", timing.nsPerSample);
+
+        if (hasCycleCounter)
+            std::fprintf(out, "\"cyclesPerSample\": %.3f, ", timing.cyclesPerSample);
+        else
+            std::fprintf(out, "\"cyclesPerSample\": null, ");
+
+        std::fprintf(out, "\"realtimeFactor\": %.2f }", realtimeFactor);
+        first = false;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    std::FILE* out = argc > 1 ? std::fopen(argv[1], "w") : stdout;
+    if (out == nullptr)
+    {
+        std::fprintf(stderr, "Can't write %s\n", argv[1]);
+        return 1;
+    }
+
+    VocalTransformerAudioProcessor processor;
+    auto* characterParameter = processor.parameters.getParameter("character");
+
+    std::fprintf(out, "{\n  \"benchmark\": \"stages\",\n  \"cpu\": \"%s\",\n  \"secondsPerCase\": %.2f,\n  \"results\": [",
+                 juce::SystemStats::getCpuModel().toRawUTF8(), secondsPerCase);
+    bool first = true;
+
+    for (const double sampleRate : sampleRates)
+    {
+        for (const int blockSize : blockSizes)
+        {
+            for (const int numChannels : channelCounts)
+            {
+                const Config config { sampleRate, blockSize, numChannels };
+                std::fprintf(stderr, "%6.0f Hz, %4d samples, %d channel%s\n", sampleRate, blockSize, numChannels,
+                             numChannels > 1 ? "s" : "");
+
+                auto write = [&](const char* stage, const Timing& timing, bool marginal = false, const juce::String& character = {})
+                {
+                    writeResult(out, first, config, stage, character, marginal, timing);
+                };
+
+                // Standalone stages
+                write("low_cut", timeChainStages(config, { 200.0f, 0.5f, 0.0f }));
+                write("tone", timeChainStages(config, { 20.0f, 0.8f, 0.0f }));
+                write("distortion", timeChainStages(config, { 20.0f, 0.5f, 0.4f }));
+                write("fdn_reverb", timeFdnReverb(config));
+                write("convolution_reverb", timeConvolutionReverb(config));
+                write("pitch_tracker", timePitchTracker(config));
+                write("pitch_shift", timePitchShifter(config, 5.0f));
+                write("formant_shift", timeFormantShifter(config, 0.7f));
+                write("voices", timeVoiceMultiplier(config, 4, 0.5f));
+
+                const Timing neutral = timeProcessor(processor, config, [](auto&) {});
+                write("neutral_chain", neutral);
+
+                // Blending a preset in at zero strength changes nothing audible, so this
+                // is the cost of applying it alone
+                write("preset_application", timeProcessor(processor, config, [](auto& p)
+                {
+                    setParameter(p, "character", (float)ROBOT);
+                    setParameter(p, "character_strength", 0.0f);
+                }) - neutral, true);
+
+                // Whole chain, with every stage on and then with each character
+                write("full_chain", timeProcessor(processor, config, [](auto& p)
+                {
+                    setParameter(p, "pitch_shift", 5.0f);
+                    setParameter(p, "formant_shift", 0.7f);
+                    setParameter(p, "voice_count", 4.0f);
+                    setParameter(p, "detune", 0.5f);
+                    setParameter(p, "reverb", 0.3f);
+                    setParameter(p, "distortion", 0.4f);
+                    setParameter(p, "low_cut", 200.0f);
+                    setParameter(p, "tone", 0.8f);
+                }));
+
+                for (int character = 0; character < NUM_CHARACTERS; ++character)
+                {
+                    const auto timing = timeProcessor(processor, config, [character](auto& p) { setParameter(p, "character", (float)character); });
+                    write("character", timing, false,
+                          characterParameter->getText(characterParameter->convertTo0to1((float)character), 32));
+                }
+            }
+        }
+    }
+
+    std::fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        std::fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Measures what each extra voice costs in the full processing chain.
+// Built by the VoiceScalingBenchmark target in CMakeLists.txt.
+// All other stages are left at their neutral settings, so the difference from the
+// 1-voice run is the cost of the voice multiplier.
+
+#include <JuceHeader.h>
+#include "../PluginProcessor.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 64;
+    constexpr int numChannels = 2;
+    constexpr double secondsPerRun = 5.0;
+
+    void setParameter(VocalTransformerAudioProcessor& processor, const juce::String& id, float value)
+    {
+        auto* parameter = processor.parameters.getParameter(id);
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    }
+
+    // Returns nanoseconds per sample frame for the given voice count
+    double timeVoiceCount(VocalTransformerAudioProcessor& processor, int voices)
+    {
+        setParameter(processor, "voice_count", (float)voices);
+        setParameter(processor, "detune", 0.5f);
+
+        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+        juce::MidiBuffer midi;
+        juce::Random random(42);
+
+        auto fillBlock = [&]
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int i = 0; i < blockSize; ++i)
+                    buffer.setSample(channel, i, random.nextFloat() * 0.2f - 0.1f);
+        };
+
+        // Warm up caches and let the voices settle
+        for (int block = 0; block < 500; ++block)
+        {
+            fillBlock();
+            processor.processBlock(buffer, midi);
+        }
+
+        const int numBlocks = (int)(secondsPerRun * sampleRate / blockSize);
+        std::chrono::nanoseconds elapsed { 0 };
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            fillBlock();
+            const auto start = std::chrono::steady_clock::now();
+            processor.processBlock(buffer, midi);
+            elapsed += std::chrono::steady_clock::now() - start;
+        }
+
+        return (double)elapsed.count() / ((double)numBlocks * blockSize);
+    }
+}
+
+int main()
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    VocalTransformerAudioProcessor processor;
+    processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    setParameter(processor, "character", 0.0f);
+
+    std::printf("%d Hz, %d-sample blocks, %d channels\n", (int)sampleRate, blockSize, numChannels);
+    std::printf("%8s %14s %18s\n", "voices", "ns/sample", "ns/sample/voice");
+
+    const double baseline = timeVoiceCount(processor, 1);
+    std::printf("%8d %14.2f %18s\n", 1, baseline, "-");
+
+    for (int voices : { 2, 4, 8, 16, 24, 32, 48, 64 })
+    {
+        const double cost = timeVoiceCount(processor, voices);
+        std::printf("%8d %14.2f %18.3f\n", voices, cost, (cost - baseline) / (voices - 1));
+    }
+
+    processor.releaseResources();
+    return 0;
+}
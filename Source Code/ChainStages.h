@@ -0,0 +1,563 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// Per-sample stages of the processing chain and the fused kernels that run them.
+// Each stage keeps its state per channel and is handed its control values for the
+// slice, so a kernel can chain several stages in one loop over the slice. The
+// kernels copy the state into locals for the loop so it stays in registers. Stages
+// that are switched off are template parameters, so each active combination gets its
+// own kernel with no per-sample branches. The block stages (shifters, voices,
+// reverb) still run between the two fused sections.
+// The filters are recursive, so they can't be vectorised along time. Kernels that
+// run a filter interleave up to laneCount channels and vectorise across them
+// instead; the others loop over each channel and vectorise along time.
+namespace ChainStages
+{
+    constexpr int laneCount = 4;                 // channels per group, one 128-bit register of floats
+    constexpr int maxChannels = 2 * laneCount;
+
+    // Topology-preserving transform state-variable filter (Zavalishin, Simper).
+    // Every response used here is a mix of the input and the band and low outputs,
+    //     y = m0 * x + m1 * band + m2 * low
+    // and the structure stays well behaved while its coefficients move, so they are
+    // only redesigned once per slice, when the control value has changed.
+    struct Svf {
+        struct Coefficients {
+            float a1 = 1.0f, a2 = 0.0f, a3 = 0.0f;
+            float m0 = 1.0f, m1 = 0.0f, m2 = 0.0f;
+        };
+
+        alignas(16) std::array<float, maxChannels> ic1 {};
+        alignas(16) std::array<float, maxChannels> ic2 {};
+
+        void reset() {
+            ic1.fill(0.0f);
+            ic2.fill(0.0f);
+        }
+
+        // Integrator gain for a cutoff, prewarped so the cutoff lands where asked
+        static float getGain(float frequency, float sampleRate) {
+            const float limited = juce::jlimit(1.0f, 0.49f * sampleRate, frequency);
+            return std::tan(juce::MathConstants<float>::pi * limited / sampleRate);
+        }
+
+        // g from getGain(), k = 1 / Q
+        static Coefficients make(float g, float k, float m0, float m1, float m2) {
+            Coefficients c;
+            c.a1 = 1.0f / (1.0f + g * (g + k));
+            c.a2 = g * c.a1;
+            c.a3 = g * c.a2;
+            c.m0 = m0;
+            c.m1 = m1;
+            c.m2 = m2;
+            return c;
+        }
+
+        static float process(float& ic1eq, float& ic2eq, float input, const Coefficients& c) {
+            const float v3 = input - ic2eq;
+            const float band = c.a1 * ic1eq + c.a2 * v3;
+            const float low = ic2eq + c.a2 * ic1eq + c.a3 * v3;
+            ic1eq = 2.0f * band - ic1eq;
+            ic2eq = 2.0f * low - ic2eq;
+            return c.m0 * input + c.m1 * band + c.m2 * low;
+        }
+    };
+
+    // 12 dB/octave Butterworth high-pass (low cut)
+    struct LowCut {
+        Svf filter;
+
+        void reset() {
+            filter.reset();
+        }
+
+        static bool isBypassed(float frequency) {
+            return frequency <= 21.0f;
+        }
+
+        static Svf::Coefficients getCoefficients(float frequency, float sampleRate) {
+            const float k = juce::MathConstants<float>::sqrt2;
+            return Svf::make(Svf::getGain(frequency, sampleRate), k, 1.0f, -k, -1.0f);
+        }
+    };
+
+    // Tilt EQ around 1 kHz. Above the middle the highs rise and the lows fall by the
+    // same amount, up to 6 dB each at the ends; below it the other way round. It is
+    // a high shelf of gain T^2 scaled by 1 / T, so the pivot stays at 0 dB.
+    struct Tone {
+        Svf filter;
+
+        static constexpr float pivotFrequency = 1000.0f;
+        static constexpr float maxTiltDb = 6.0f;
+        static constexpr float neutralWidth = 0.01f;    // flat from 0.49 to 0.51
+
+        void reset() {
+            filter.reset();
+        }
+
+        static bool isBypassed(float amount) {
+            return std::abs(amount - 0.5f) <= neutralWidth;
+        }
+
+        static Svf::Coefficients getCoefficients(float amount, float sampleRate) {
+            // Measured from the edge of the neutral range, so leaving it doesn't jump
+            const float offset = amount - 0.5f;
+            const float tilt = juce::jmax(0.0f, std::abs(offset) - neutralWidth) / (0.5f - neutralWidth);
+            const float t = juce::Decibels::decibelsToGain(std::copysign(tilt * maxTiltDb, offset));
+            const float k = juce::MathConstants<float>::sqrt2;
+
+            return Svf::make(Svf::getGain(pivotFrequency, sampleRate) * std::sqrt(t), k,
+                             t, k * (1.0f - t), (1.0f - t * t) / t);
+        }
+    };
+
+    // Soft clipping distortion - more amount means more distortion
+    // tanh is a 13/6 minimax rational with |error| < 1e-6 for every input. The
+    // antialiased form is first-order ADAA: each output is the mean of tanh over the
+    // segment between the last two driven samples,
+    //     (logcosh(u[n]) - logcosh(u[n-1])) / (u[n] - u[n-1])
+    // which removes most of the aliasing the clipping would fold back. It delays the
+    // shaped signal by half a sample, so the dry signal is averaged the same way and
+    // the mix stays aligned.
+    // Nothing here branches or compares floats. Float compares can raise FP
+    // exceptions, so without fast-math flags compilers won't turn them into vector
+    // selects, and the loops that call these functions would stay scalar.
+    enum class DistortionMode { off, plain, antialiased };
+
+    struct Distortion {
+        struct ChannelState {
+            float lastInput = 0.0f;
+            float lastDriven = 0.0f;
+            float lastResidual = std::log(2.0f);   // logCoshResidual(lastDriven)
+        };
+
+        std::array<ChannelState, maxChannels> channels {};
+
+        void reset() {
+            channels.fill({});
+        }
+
+        static bool isBypassed(float amount) {
+            return amount <= 0.001f;
+        }
+
+        static float getDrive(float amount) {
+            return 1.0f + 20.0f * amount;
+        }
+
+        // min(x, limit) and max(x, limit) without a compare, exact while x is in range
+        static float limitAbove(float x, float limit) {
+            const float over = x - limit;
+            return x - 0.5f * (over + std::abs(over));
+        }
+
+        static float limitBelow(float x, float limit) {
+            const float under = x - limit;
+            return x - 0.5f * (under - std::abs(under));
+        }
+
+        static float fastTanh(float x) {
+            // Past this point the result rounds to +-1 in single precision
+            constexpr float limit = 7.90531110763549805f;
+            x = limitBelow(limitAbove(x, limit), -limit);
+            const float x2 = x * x;
+
+            float p = x2 * -2.76076847742355e-16f + 2.00018790482477e-13f;
+            p = x2 * p - 8.60467152213735e-11f;
+            p = x2 * p + 5.12229709037114e-08f;
+            p = x2 * p + 1.48572235717979e-05f;
+            p = x2 * p + 6.37261928875436e-04f;
+            p = x2 * p + 4.89352455891786e-03f;
+
+            float q = x2 * 1.19825839466702e-06f + 1.18534705686654e-04f;
+            q = x2 * q + 2.26843463243900e-03f;
+            q = x2 * q + 4.89352518554385e-03f;
+
+            return x * p / q;
+        }
+
+        // log1p(exp(-2|x|)), so that logcosh(x) = |x| - log(2) + logCoshResidual(x).
+        // Keeping the large |x| term separate lets the ADAA difference cancel it
+        // exactly; the residual itself is accurate to 3e-7.
+        static float logCoshResidual(float x) {
+            // exp(-2|x|) as 2^n * 2^f, n rounded to nearest so |f| <= 0.5
+            const float e = limitBelow(-2.88539008f * std::abs(x), -126.0f);
+            const int n = (int) (e - 0.5f);
+            const float f = e - (float) n;
+            const float mantissa = 1.0f + f * (0.69314718f + f * (0.24022651f + f * (0.05550411f
+                                 + f * (0.00961813f + f * (0.00133336f + f * 0.00015404f)))));
+
+            const std::int32_t exponentBits = (n + 127) << 23;
+            float exponent;
+            std::memcpy(&exponent, &exponentBits, sizeof(exponent));
+            const float t = mantissa * exponent;
+
+            // log1p(t) = 2 atanh(s), s = t / (2 + t) <= 1/3
+            const float s = t / (2.0f + t);
+            const float s2 = s * s;
+            return 2.0f * s * (1.0f + s2 * (1.0f / 3.0f + s2 * (1.0f / 5.0f + s2 * (1.0f / 7.0f
+                 + s2 * (1.0f / 9.0f + s2 * (1.0f / 11.0f))))));
+        }
+
+        static float process(float input, float amount) {
+            const float distorted = fastTanh(input * getDrive(amount));
+
+            // Mix between clean and distorted signal
+            return input + amount * (distorted - input);
+        }
+
+        static float processAntialiased(ChannelState& state, float input, float amount) {
+            const float driven = input * getDrive(amount);
+            const float residual = logCoshResidual(driven);
+            const float delta = driven - state.lastDriven;
+            const float logCoshDelta = (std::abs(driven) - std::abs(state.lastDriven)) + (residual - state.lastResidual);
+
+            // The quotient loses precision as delta -> 0, where tanh of the midpoint is
+            // the better estimate of the same value. Weighting them by delta^2 : eps^2
+            // moves between the two smoothly without a branch.
+            constexpr float epsilonSquared = 1.0e-4f;
+            const float midpoint = fastTanh(0.5f * (driven + state.lastDriven));
+            const float distorted = (logCoshDelta * delta + epsilonSquared * midpoint) / (delta * delta + epsilonSquared);
+            const float clean = 0.5f * (input + state.lastInput);
+
+            state.lastInput = input;
+            state.lastDriven = driven;
+            state.lastResidual = residual;
+
+            return clean + amount * (distorted - clean);
+        }
+    };
+
+    // State of every per-sample stage
+    struct State {
+        LowCut lowCut;
+        Tone tone;
+        Distortion distortion;
+
+        void reset() {
+            lowCut.reset();
+            tone.reset();
+            distortion.reset();
+        }
+    };
+
+    // Per-sample values of one control for the current slice
+    template <int maxSamples>
+    struct Ramp {
+        alignas(16) std::array<float, maxSamples> values {};
+        float steadyValue = std::numeric_limits<float>::quiet_NaN(); // smoother value behind values, NaN while ramping
+
+        const float* data() const {
+            return values.data();
+        }
+
+        // Takes the next numSamples values of a smoother, passed through convert. Once
+        // the smoother has settled, the array is filled once and reused until the
+        // value changes again, so the conversion isn't repeated either.
+        template <typename SmoothedType, typename Convert = float (*)(float)>
+        void fill(SmoothedType& smoothed, int numSamples, Convert convert = [](float x) { return x; }) {
+            if (! smoothed.isSmoothing()) {
+                const float target = smoothed.getTargetValue();
+                if (target != steadyValue) {
+                    values.fill(convert(target));
+                    steadyValue = target;
+                }
+                return;
+            }
+
+            for (int i = 0; i < numSamples; ++i)
+                values[(size_t) i] = convert(smoothed.getNextValue());
+            steadyValue = std::numeric_limits<float>::quiet_NaN();
+        }
+    };
+
+    // Filter coefficients for the current slice. They follow the smoother's value at
+    // the end of the slice and are only redesigned when that value changes.
+    struct FilterControl {
+        Svf::Coefficients coefficients;
+        float designedValue = std::numeric_limits<float>::quiet_NaN();
+        float sampleRate = 44100.0f;
+
+        void prepare(double newSampleRate) {
+            sampleRate = (float) newSampleRate;
+            designedValue = std::numeric_limits<float>::quiet_NaN();
+        }
+
+        template <typename SmoothedType, typename Design>
+        void fill(SmoothedType& smoothed, int numSamples, Design design) {
+            const float value = smoothed.isSmoothing() ? smoothed.skip(numSamples) : smoothed.getTargetValue();
+            if (value != designedValue) {
+                coefficients = design(value, sampleRate);
+                designedValue = value;
+            }
+        }
+    };
+
+    // Control values for one slice, filled before the kernels run
+    template <int maxSamples>
+    struct Controls {
+        Ramp<maxSamples> inputGain;
+        FilterControl lowCut;         // see LowCut::getCoefficients
+        FilterControl tone;           // see Tone::getCoefficients
+        Ramp<maxSamples> distortion;
+        Ramp<maxSamples> outputGain;
+
+        void prepare(double sampleRate) {
+            lowCut.prepare(sampleRate);
+            tone.prepare(sampleRate);
+        }
+    };
+
+    // Up to laneCount channels of a slice, interleaved so that each sample of the
+    // group is one vector. Lanes without a channel carry silence.
+    template <int maxSamples>
+    struct LaneBlock {
+        alignas(16) std::array<std::array<float, laneCount>, maxSamples> samples;
+
+        void load(const juce::AudioBuffer<float>& block, int firstChannel, int numChannels) {
+            const int numSamples = block.getNumSamples();
+            for (int lane = 0; lane < laneCount; ++lane) {
+                const float* data = lane < numChannels ? block.getReadPointer(firstChannel + lane) : nullptr;
+                for (int i = 0; i < numSamples; ++i)
+                    samples[(size_t) i][(size_t) lane] = data != nullptr ? data[i] : 0.0f;
+            }
+        }
+
+        void store(juce::AudioBuffer<float>& block, int firstChannel, int numChannels) const {
+            const int numSamples = block.getNumSamples();
+            for (int lane = 0; lane < numChannels; ++lane) {
+                float* data = block.getWritePointer(firstChannel + lane);
+                for (int i = 0; i < numSamples; ++i)
+                    data[i] = samples[(size_t) i][(size_t) lane];
+            }
+        }
+    };
+
+    // Optional gain, then one filter, on up to laneCount channels at a time. The
+    // controls are read before the lane loop, otherwise the compiler has to assume
+    // the stores to the frame could change them and won't vectorise it.
+    template <bool useGain, int maxSamples>
+    void renderFilter(Svf& filter, const Svf::Coefficients& coefficients, juce::AudioBuffer<float>& block, const float* gain) {
+        const int numSamples = block.getNumSamples();
+        const int numChannels = juce::jmin(block.getNumChannels(), maxChannels);
+
+        for (int first = 0; first < numChannels; first += laneCount) {
+            const int groupChannels = juce::jmin(laneCount, numChannels - first);
+            LaneBlock<maxSamples> lanes;
+            lanes.load(block, first, groupChannels);
+
+            std::array<float, laneCount> ic1, ic2;
+            std::copy_n(filter.ic1.begin() + first, laneCount, ic1.begin());
+            std::copy_n(filter.ic2.begin() + first, laneCount, ic2.begin());
+
+            for (int i = 0; i < numSamples; ++i) {
+                auto& frame = lanes.samples[(size_t) i];
+                const float sampleGain = useGain ? gain[i] : 1.0f;
+                for (int lane = 0; lane < laneCount; ++lane) {
+                    float x = frame[(size_t) lane];
+                    if constexpr (useGain)
+                        x *= sampleGain;
+                    frame[(size_t) lane] = Svf::process(ic1[(size_t) lane], ic2[(size_t) lane], x, coefficients);
+                }
+            }
+
+            std::copy_n(ic1.begin(), laneCount, filter.ic1.begin() + first);
+            std::copy_n(ic2.begin(), laneCount, filter.ic2.begin() + first);
+            lanes.store(block, first, groupChannels);
+        }
+    }
+
+    // Input gain -> low cut
+    template <bool useLowCut, int maxSamples>
+    void renderInput(State& state, juce::AudioBuffer<float>& block, const Controls<maxSamples>& controls) {
+        const int numSamples = block.getNumSamples();
+        const int numChannels = juce::jmin(block.getNumChannels(), maxChannels);
+        const float* gain = controls.inputGain.data();
+
+        if constexpr (useLowCut) {
+            renderFilter<true, maxSamples>(state.lowCut.filter, controls.lowCut.coefficients, block, gain);
+        } else {
+            for (int channel = 0; channel < numChannels; ++channel) {
+                float* data = block.getWritePointer(channel);
+                for (int i = 0; i < numSamples; ++i)
+                    data[i] *= gain[i];
+            }
+        }
+    }
+
+    // Distortion and output gain on one sample
+    template <DistortionMode distortionMode, bool useGain>
+    float renderDistortionAndGain(Distortion::ChannelState& state, float x, float distortion, float gain) {
+        if constexpr (distortionMode == DistortionMode::plain)
+            x = Distortion::process(x, distortion);
+        if constexpr (distortionMode == DistortionMode::antialiased)
+            x = Distortion::processAntialiased(state, x, distortion);
+        if constexpr (useGain)
+            x *= gain;
+        return x;
+    }
+
+    // Tone -> distortion -> output gain. The tone runs across the channels first;
+    // distortion and gain then run along each channel, where they vectorise over
+    // time and use every lane even for mono or stereo. The output gain is applied
+    // ahead of the reverb, which is linear, so the result is the same as applying it
+    // last. When the distortion runs oversampled this only applies the tone, and the
+    // gain is applied with the distortion instead.
+    template <bool useTone, DistortionMode distortionMode, bool useGain, int maxSamples>
+    void renderOutput(State& state, juce::AudioBuffer<float>& block, const Controls<maxSamples>& controls) {
+        const int numSamples = block.getNumSamples();
+        const int numChannels = juce::jmin(block.getNumChannels(), maxChannels);
+        const float* distortion = controls.distortion.data();
+        const float* gain = controls.outputGain.data();
+
+        if constexpr (useTone)
+            renderFilter<false, maxSamples>(state.tone.filter, controls.tone.coefficients, block, nullptr);
+
+        if constexpr (distortionMode == DistortionMode::off && ! useGain)
+            return;
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            float* data = block.getWritePointer(channel);
+            Distortion::ChannelState distortionState = state.distortion.channels[(size_t) channel];
+
+            for (int i = 0; i < numSamples; ++i)
+                data[i] = renderDistortionAndGain<distortionMode, useGain>(distortionState, data[i], distortion[i], gain[i]);
+
+            state.distortion.channels[(size_t) channel] = distortionState;
+        }
+    }
+
+    // Distortion, dry/wet mix and output gain on one oversampled channel. The
+    // controls are held for each group of factor samples.
+    template <DistortionMode distortionMode>
+    void renderOversampledChannel(Distortion::ChannelState& state, float* data, int numSamples,
+                                  const float* distortion, const float* gain) {
+        Distortion::ChannelState local = state;
+
+        for (int i = 0; i < numSamples; ++i)
+            data[i] = renderDistortionAndGain<distortionMode, true>(local, data[i], distortion[i], gain[i]);
+
+        state = local;
+    }
+
+    // Runs the distortion at 2x or 4x through juce::dsp::Oversampling. While one of
+    // them is selected it runs even with the distortion at zero, so the latency the
+    // host sees doesn't depend on the amount.
+    template <int maxSamples>
+    class OversampledDistortion {
+    public:
+        static constexpr int maxOrder = 2;   // 4x
+
+        void prepare(int numChannels) {
+            for (int order = 1; order <= maxOrder; ++order) {
+                auto& oversampler = oversamplers[(size_t) (order - 1)];
+                oversampler = std::make_unique<juce::dsp::Oversampling<float>>(
+                    (size_t) numChannels, (size_t) order,
+                    juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, true, true);
+                oversampler->initProcessing((size_t) maxSamples);
+            }
+        }
+
+        void reset() {
+            for (auto& oversampler : oversamplers)
+                if (oversampler != nullptr)
+                    oversampler->reset();
+        }
+
+        // Whole samples, the oversamplers are built with integer latency
+        int getLatencyInSamples(int order) const {
+            if (order <= 0 || oversamplers[(size_t) (order - 1)] == nullptr)
+                return 0;
+            return juce::roundToInt(oversamplers[(size_t) (order - 1)]->getLatencyInSamples());
+        }
+
+        void process(State& state, juce::AudioBuffer<float>& block, const Controls<maxSamples>& controls,
+                     DistortionMode mode, int order) {
+            auto& oversampler = *oversamplers[(size_t) (order - 1)];
+            const int numSamples = block.getNumSamples();
+            const int numChannels = juce::jmin(block.getNumChannels(), maxChannels);
+            const int factor = 1 << order;
+
+            for (int i = 0; i < numSamples; ++i) {
+                for (int k = 0; k < factor; ++k) {
+                    distortion[(size_t) (i * factor + k)] = controls.distortion.data()[i];
+                    gain[(size_t) (i * factor + k)] = controls.outputGain.data()[i];
+                }
+            }
+
+            juce::dsp::AudioBlock<float> baseBlock(block.getArrayOfWritePointers(), (size_t) numChannels, (size_t) numSamples);
+            auto upsampled = oversampler.processSamplesUp(baseBlock);
+            const int numUpsampled = (int) upsampled.getNumSamples();
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                auto& channelState = state.distortion.channels[(size_t) channel];
+                float* data = upsampled.getChannelPointer((size_t) channel);
+
+                switch (mode) {
+                    case DistortionMode::off:
+                        renderOversampledChannel<DistortionMode::off>(channelState, data, numUpsampled, distortion.data(), gain.data());
+                        break;
+                    case DistortionMode::plain:
+                        renderOversampledChannel<DistortionMode::plain>(channelState, data, numUpsampled, distortion.data(), gain.data());
+                        break;
+                    case DistortionMode::antialiased:
+                        renderOversampledChannel<DistortionMode::antialiased>(channelState, data, numUpsampled, distortion.data(), gain.data());
+                        break;
+                }
+            }
+
+            oversampler.processSamplesDown(baseBlock);
+        }
+
+    private:
+        std::array<std::unique_ptr<juce::dsp::Oversampling<float>>, maxOrder> oversamplers;
+        alignas(16) std::array<float, maxSamples << maxOrder> distortion {};
+        alignas(16) std::array<float, maxSamples << maxOrder> gain {};
+    };
+
+    // Picks the kernel for the stages that are active in this slice
+    template <int maxSamples>
+    void renderInputStages(State& state, juce::AudioBuffer<float>& block, const Controls<maxSamples>& controls, bool useLowCut) {
+        if (useLowCut)
+            renderInput<true>(state, block, controls);
+        else
+            renderInput<false>(state, block, controls);
+    }
+
+    template <int maxSamples>
+    void renderOutputStages(State& state, juce::AudioBuffer<float>& block, const Controls<maxSamples>& controls,
+                            bool useTone, DistortionMode distortionMode) {
+        constexpr auto off = DistortionMode::off;
+        constexpr auto plain = DistortionMode::plain;
+        constexpr auto antialiased = DistortionMode::antialiased;
+
+        if (useTone) {
+            switch (distortionMode) {
+                case off: renderOutput<true, off, true>(state, block, controls); break;
+                case plain: renderOutput<true, plain, true>(state, block, controls); break;
+                case antialiased: renderOutput<true, antialiased, true>(state, block, controls); break;
+            }
+        } else {
+            switch (distortionMode) {
+                case off: renderOutput<false, off, true>(state, block, controls); break;
+                case plain: renderOutput<false, plain, true>(state, block, controls); break;
+                case antialiased: renderOutput<false, antialiased, true>(state, block, controls); break;
+            }
+        }
+    }
+
+    // Tone at the base rate, then distortion and output gain oversampled
+    template <int maxSamples>
+    void renderOversampledOutputStages(State& state, juce::AudioBuffer<float>& block, const Controls<maxSamples>& controls,
+                                       OversampledDistortion<maxSamples>& oversampled, bool useTone,
+                                       DistortionMode distortionMode, int order) {
+        if (useTone)
+            renderOutput<true, DistortionMode::off, false>(state, block, controls);
+
+        oversampled.process(state, block, controls, distortionMode, order);
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// The picture of the selected character above the selector. Each icon is rendered
+// into an image once for the component's size and the display's scale factor, so
+// a repaint is one blit. The component is opaque and only repaints itself when the
+// character changes, which leaves the rest of the editor alone.
+class CharacterIcon : public juce::Component
+{
+public:
+    explicit CharacterIcon(juce::Colour background) : backgroundColour(background)
+    {
+        setOpaque(true);
+    }
+
+    // The path is centred and scaled to fit when it is rendered
+    void setIcon(int character, const juce::Path& path, juce::Colour colour)
+    {
+        auto& icon = icons[character];
+        const auto bounds = path.getBounds();
+        icon.path = path;
+        icon.path.applyTransform(juce::AffineTransform::translation(-bounds.getCentreX(), -bounds.getCentreY()));
+        icon.colour = colour;
+        icon.image = {};
+    }
+
+    void setCharacter(int character)
+    {
+        if (character != currentCharacter)
+        {
+            currentCharacter = character;
+            repaint();
+        }
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        // Moving the window to a display with another scale makes every image stale
+        const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+        if (scale != imageScale)
+        {
+            clearImages();
+            imageScale = scale;
+        }
+
+        const auto it = icons.find(currentCharacter);
+        if (it == icons.end())
+        {
+            g.fillAll(backgroundColour);
+            return;
+        }
+
+        auto& icon = it->second;
+        if (! icon.image.isValid())
+            icon.image = renderIcon(icon, scale);
+
+        g.drawImage(icon.image, getLocalBounds().toFloat());
+    }
+
+    void resized() override
+    {
+        clearImages();
+    }
+
+private:
+    struct Icon
+    {
+        juce::Path path;
+        juce::Colour colour;
+        juce::Image image;
+    };
+
+    void clearImages()
+    {
+        for (auto& pair : icons)
+            pair.second.image = {};
+    }
+
+    juce::Image renderIcon(const Icon& icon, float scale) const
+    {
+        juce::Image image(juce::Image::RGB,
+                          juce::jmax(1, juce::roundToInt((float)getWidth() * scale)),
+                          juce::jmax(1, juce::roundToInt((float)getHeight() * scale)),
+                          false);
+
+        juce::Graphics g(image);
+        g.addTransform(juce::AffineTransform::scale(scale));
+        g.fillAll(backgroundColour);
+
+        const auto bounds = icon.path.getBounds();
+        const float size = (float)juce::jmin(getWidth(), getHeight());
+        const float fit = size / juce::jmax(1.0f, bounds.getWidth(), bounds.getHeight());
+
+        g.setColour(icon.colour);
+        g.fillPath(icon.path, juce::AffineTransform::scale(fit).translated((float)getWidth() * 0.5f,
+                                                                            (float)getHeight() * 0.5f));
+        return image;
+    }
+
+    juce::Colour backgroundColour;
+    std::map<int, Icon> icons;
+    int currentCharacter = 0;
+    float imageScale = 0.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CharacterIcon)
+};
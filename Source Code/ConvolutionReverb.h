@@ -0,0 +1,711 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Convolution reverb with a two-stage partitioned FFT convolver.
+// The head of the impulse response is split into short partitions (64 samples
+// unless set otherwise) and the rest into 1024-sample ones, each run as uniformly
+// partitioned overlap-save convolution over a frequency-domain delay line of past
+// input spectra. The wet output is one head partition late, heard as a little extra
+// pre-delay; the dry signal is not delayed. The head covers exactly the part of the
+// response that the tail stage cannot deliver in time, and the tail's work is
+// spread over the head blocks it spans, so every head block costs about the same:
+// one small FFT pair plus its share of the tail's multiply-adds (and, once per tail
+// block, the tail's forward and inverse FFTs).
+//
+// Impulse responses are loaded, resampled, normalised and transformed on a
+// background thread. Finished kernels are handed to the audio thread through an
+// atomic slot and picked up at the start of a tail block; the old one goes back
+// through a second slot to be deleted on the loader thread. Every buffer the audio
+// thread touches is sized in prepare() for the longest response, so a swap never
+// allocates or locks.
+//
+// The loader only starts with startLoading(), so an instance that never uses the
+// convolution reverb never builds a response. While the reverb is active, or a swap
+// is under way, it polls, since the audio thread changes rooms without waking it.
+// Otherwise it sleeps until prepare(), loadFile() or startLoading() wakes it.
+class ConvolutionReverb : private juce::Thread {
+public:
+    // Built-in rooms, synthesised rather than loaded
+    enum Room {
+        room = 0,
+        cathedral,
+        metalTube,
+        numRooms
+    };
+
+    // Longer responses are cut off here
+    static constexpr double maxImpulseSeconds = 6.0;
+
+    ConvolutionReverb() : juce::Thread("Impulse response loader") {}
+
+    ~ConvolutionReverb() override {
+        stopThread(4000);
+        delete current;
+        delete pending.exchange(nullptr);
+        delete retired.exchange(nullptr);
+    }
+
+    // Length of the head partitions, a power of two from 32 to 256 samples. Shorter
+    // means less wet delay for more CPU. Call before prepare().
+    void setHeadSize(int newHeadSize) {
+        headSize = juce::jlimit(minHeadSize, maxHeadSize, juce::nextPowerOfTwo(newHeadSize));
+    }
+
+    // Not called while audio is running
+    void prepare(const juce::dsp::ProcessSpec& spec) {
+        sampleRate = spec.sampleRate;
+        layout = HeadLayout(headSize);
+
+        headFft = std::make_unique<juce::dsp::FFT>(layout.order);
+        tailFft = std::make_unique<juce::dsp::FFT>(tailOrder);
+        headFrame.assign((size_t) (2 * layout.fftSize), 0.0f);
+        tailFrame.assign((size_t) (2 * tailFftSize), 0.0f);
+        headSum.assign((size_t) (2 * layout.bins), 0.0f);
+
+        tailSlots = juce::jmax(1, layout.getNumTailPartitions((int) std::ceil(maxImpulseSeconds * sampleRate)));
+
+        for (auto& channel : channels) {
+            channel.headInput.assign((size_t) layout.fftSize, 0.0f);
+            channel.headSpectra.assign((size_t) (layout.partitions * 2 * layout.bins), 0.0f);
+            channel.headOutput.assign((size_t) layout.size, 0.0f);
+            channel.tailInput.assign((size_t) tailFftSize, 0.0f);
+            channel.tailSpectra.assign((size_t) (tailSlots * 2 * tailBins), 0.0f);
+            channel.tailSum.assign((size_t) (2 * tailBins), 0.0f);
+            channel.tailOutput.assign((size_t) tailSize, 0.0f);
+            channel.inputFifo.assign((size_t) layout.size, 0.0f);
+            channel.outputFifo.assign((size_t) layout.size, 0.0f);
+        }
+
+        wetLevel.reset(sampleRate, 0.05);
+        dryLevel.reset(sampleRate, 0.05);
+
+        // Kernels are built for one rate, so the loader starts again at the new one
+        delete current;
+        current = nullptr;
+        delete pending.exchange(nullptr);
+        targetSampleRate = sampleRate;
+        targetHeadSize = headSize;
+        preparationCount.fetch_add(1);
+        requestVersion.fetch_add(1);
+
+        reset();
+        notify();
+    }
+
+    // Starts the loader, or wakes it if it's asleep. Not on the audio thread.
+    void startLoading() {
+        if (! isThreadRunning())
+            startThread();
+        else
+            notify();
+    }
+
+    // The loader isn't running or is asleep, so startLoading() is due before it sees
+    // anything the audio thread asks for. Lock-free.
+    bool needsWaking() const {
+        return ! isThreadRunning() || sleeping.load(std::memory_order_acquire);
+    }
+
+    // Whether the reverb is in use, which keeps the loader polling. Lock-free.
+    void setActive(bool shouldBeActive) {
+        active.store(shouldBeActive, std::memory_order_release);
+    }
+
+    void reset() {
+        for (auto& channel : channels) {
+            std::fill(channel.headInput.begin(), channel.headInput.end(), 0.0f);
+            std::fill(channel.headSpectra.begin(), channel.headSpectra.end(), 0.0f);
+            std::fill(channel.headOutput.begin(), channel.headOutput.end(), 0.0f);
+            std::fill(channel.tailInput.begin(), channel.tailInput.end(), 0.0f);
+            std::fill(channel.tailSpectra.begin(), channel.tailSpectra.end(), 0.0f);
+            std::fill(channel.tailSum.begin(), channel.tailSum.end(), 0.0f);
+            std::fill(channel.tailOutput.begin(), channel.tailOutput.end(), 0.0f);
+            std::fill(channel.inputFifo.begin(), channel.inputFifo.end(), 0.0f);
+            std::fill(channel.outputFifo.begin(), channel.outputFifo.end(), 0.0f);
+        }
+
+        fifoPos = 0;
+        headSlot = 0;
+        tailSlot = 0;
+        tailFill = 0;
+
+        wetLevel.setCurrentAndTargetValue(wetLevel.getTargetValue());
+        dryLevel.setCurrentAndTargetValue(dryLevel.getTargetValue());
+    }
+
+    // Built-in room used while no file is loaded. Lock-free, so the audio thread
+    // can follow the character selection; the polling loader picks it up.
+    void setRoom(Room newRoom) {
+        if (requestedRoom.exchange((int) newRoom, std::memory_order_relaxed) != (int) newRoom)
+            requestVersion.fetch_add(1);
+    }
+
+    // An empty file goes back to the built-in rooms. Message thread only.
+    void loadFile(const juce::File& file) {
+        const juce::ScopedLock lock(fileLock);
+        requestedFile = file;
+        requestVersion.fetch_add(1);
+        notify();
+    }
+
+    juce::File getFile() const {
+        const juce::ScopedLock lock(fileLock);
+        return requestedFile;
+    }
+
+    // Ramped over 50 ms
+    void setMix(float newWetLevel, float newDryLevel) {
+        wetLevel.setTargetValue(newWetLevel);
+        dryLevel.setTargetValue(newDryLevel);
+    }
+
+    // Length of the response in use plus the head block, audio thread only
+    int getTailInSamples() const {
+        return (current != nullptr ? current->length : 0) + layout.size;
+    }
+
+    // For offline rendering: waits until the response for the latest settings is in
+    // use, so the first block already has it. Only call right after prepare() or
+    // reset(), never while process() may run. Starts the loader if need be.
+    bool waitUntilReady(int timeoutMilliseconds) {
+        const auto start = juce::Time::getMillisecondCounter();
+        startLoading();
+
+        for (;;) {
+            acquireKernel();
+
+            if (loadedVersion.load(std::memory_order_acquire) == requestVersion.load()
+                && pending.load(std::memory_order_acquire) == nullptr && current != nullptr)
+                return true;
+
+            if ((int) (juce::Time::getMillisecondCounter() - start) > timeoutMilliseconds)
+                return false;
+
+            juce::Thread::sleep(5);
+        }
+    }
+
+    // Mono or stereo, in place. Each output channel has its own response.
+    void process(juce::AudioBuffer<float>& buffer) {
+        const int numSamples = buffer.getNumSamples();
+        const int numChannels = juce::jmin(buffer.getNumChannels(), (int) channels.size());
+        if (numChannels <= 0 || headFft == nullptr)
+            return;
+
+        for (int start = 0; start < numSamples;) {
+            const int count = juce::jmin(numSamples - start, layout.size - fifoPos);
+
+            // Every channel follows the same ramp
+            for (int i = 0; i < count; ++i) {
+                wetGains[(size_t) i] = wetLevel.getNextValue();
+                dryGains[(size_t) i] = dryLevel.getNextValue();
+            }
+
+            for (int c = 0; c < numChannels; ++c) {
+                auto& channel = channels[(size_t) c];
+                float* data = buffer.getWritePointer(c, start);
+                std::copy(data, data + count, channel.inputFifo.begin() + fifoPos);
+
+                const float* wet = channel.outputFifo.data() + fifoPos;
+                for (int i = 0; i < count; ++i)
+                    data[i] = dryGains[(size_t) i] * data[i] + wetGains[(size_t) i] * wet[i];
+            }
+
+            fifoPos += count;
+            start += count;
+
+            if (fifoPos == layout.size) {
+                processHeadBlock(numChannels);
+                fifoPos = 0;
+            }
+        }
+    }
+
+private:
+    static constexpr int pollMilliseconds = 20;
+    static constexpr int minHeadSize = 32;
+    static constexpr int maxHeadSize = 256;
+
+    static constexpr int tailOrder = 11;
+    static constexpr int tailFftSize = 1 << tailOrder;
+    static constexpr int tailSize = tailFftSize / 2;
+    static constexpr int tailBins = tailSize + 1;
+
+    // Sizes that follow from the head partition length
+    struct HeadLayout {
+        explicit HeadLayout(int partitionSize = 64)
+            : order(juce::roundToInt(std::log2((double) partitionSize)) + 1),
+              fftSize(1 << order),
+              size(partitionSize),
+              bins(partitionSize + 1),
+              blocksPerTail(tailSize / partitionSize),
+              // A tail block's output is ready one tail block after its input, and the
+              // wet path runs one head block late, so the head covers the rest of those two
+              length(2 * tailSize - partitionSize),
+              partitions(length / partitionSize) {}
+
+        int getNumTailPartitions(int responseLength) const {
+            return juce::jmax(0, (responseLength - length + tailSize - 1) / tailSize);
+        }
+
+        int order, fftSize, size, bins, blocksPerTail, length, partitions;
+    };
+
+    // Partition spectra of one response, split into real and imaginary halves
+    struct Kernel {
+        double sampleRate = 0.0;
+        int headSize = 0;
+        int length = 0;
+        int numTailPartitions = 0;
+        std::array<std::vector<float>, 2> head, tail;
+    };
+
+    struct Channel {
+        std::vector<float> headInput;       // previous and current head block
+        std::vector<float> headSpectra;     // delay line of input spectra, one per head partition
+        std::vector<float> headOutput;
+        std::vector<float> tailInput;       // previous and current tail block
+        std::vector<float> tailSpectra;
+        std::vector<float> tailSum;
+        std::vector<float> tailOutput;      // read out one head block at a time
+        std::vector<float> inputFifo;
+        std::vector<float> outputFifo;
+    };
+
+    //==========================================================================
+    // Audio thread
+
+    void processHeadBlock(int numChannels) {
+        // Tail blocks complete every tailSize / layout.size head blocks, which is where a
+        // new kernel is taken
+        const int tailWritePos = tailSize + tailFill;
+        tailFill += layout.size;
+        const bool tailBlockDone = tailFill == tailSize;
+        const int phase = tailBlockDone ? 0 : tailFill / layout.size;
+
+        if (tailBlockDone)
+            acquireKernel();
+
+        headSlot = (headSlot + 1) % layout.partitions;
+        if (tailBlockDone)
+            tailSlot = (tailSlot + 1) % tailSlots;
+
+        for (int c = 0; c < numChannels; ++c) {
+            auto& channel = channels[(size_t) c];
+
+            processHead(channel, c);
+
+            // Feed the tail and, once a block is full, add its spectrum to the delay line
+            std::copy(channel.inputFifo.begin(), channel.inputFifo.end(), channel.tailInput.begin() + tailWritePos);
+
+            if (tailBlockDone) {
+                float* spectrum = channel.tailSpectra.data() + tailSlot * 2 * tailBins;
+                forward(*tailFft, channel.tailInput.data(), tailFftSize, tailFrame.data(), spectrum, tailBins);
+                std::copy(channel.tailInput.begin() + tailSize, channel.tailInput.end(), channel.tailInput.begin());
+                std::fill(channel.tailSum.begin(), channel.tailSum.end(), 0.0f);
+            }
+
+            accumulateTail(channel, c, phase);
+
+            // This head block's output, then the next tail block once it is all read
+            const float* tail = channel.tailOutput.data() + phase * layout.size;
+            for (int i = 0; i < layout.size; ++i)
+                channel.outputFifo[(size_t) i] = channel.headOutput[(size_t) i] + tail[i];
+
+            if (phase == layout.blocksPerTail - 1) {
+                inverse(*tailFft, channel.tailSum.data(), tailBins, tailFftSize, tailFrame.data());
+                std::copy(tailFrame.begin() + tailSize, tailFrame.begin() + tailFftSize, channel.tailOutput.begin());
+            }
+        }
+
+        if (tailBlockDone)
+            tailFill = 0;
+    }
+
+    void processHead(Channel& channel, int c) {
+        std::copy(channel.headInput.begin() + layout.size, channel.headInput.end(), channel.headInput.begin());
+        std::copy(channel.inputFifo.begin(), channel.inputFifo.end(), channel.headInput.begin() + layout.size);
+
+        float* spectrum = channel.headSpectra.data() + headSlot * 2 * layout.bins;
+        forward(*headFft, channel.headInput.data(), layout.fftSize, headFrame.data(), spectrum, layout.bins);
+
+        if (current == nullptr) {
+            std::fill(channel.headOutput.begin(), channel.headOutput.end(), 0.0f);
+            return;
+        }
+
+        std::fill(headSum.begin(), headSum.end(), 0.0f);
+        const float* filters = current->head[(size_t) c].data();
+
+        for (int p = 0; p < layout.partitions; ++p) {
+            const int slot = (headSlot - p + layout.partitions) % layout.partitions;
+            multiplyAdd(channel.headSpectra.data() + slot * 2 * layout.bins, filters + p * 2 * layout.bins,
+                        headSum.data(), layout.bins);
+        }
+
+        inverse(*headFft, headSum.data(), layout.bins, layout.fftSize, headFrame.data());
+        std::copy(headFrame.begin() + layout.size, headFrame.begin() + layout.fftSize, channel.headOutput.begin());
+    }
+
+    // Partitions phase, phase + 16, ... so each head block does a sixteenth of the work
+    void accumulateTail(Channel& channel, int c, int phase) {
+        if (current == nullptr)
+            return;
+
+        const float* filters = current->tail[(size_t) c].data();
+
+        for (int p = phase; p < current->numTailPartitions; p += layout.blocksPerTail) {
+            const int slot = (tailSlot - p + tailSlots) % tailSlots;
+            multiplyAdd(channel.tailSpectra.data() + slot * 2 * tailBins, filters + p * 2 * tailBins,
+                        channel.tailSum.data(), tailBins);
+        }
+    }
+
+    // sum += x * h, on split real and imaginary halves so it vectorises
+    static void multiplyAdd(const float* x, const float* h, float* sum, int numBins) {
+        const float* xIm = x + numBins;
+        const float* hIm = h + numBins;
+        float* sumIm = sum + numBins;
+
+        for (int k = 0; k < numBins; ++k) {
+            sum[k] += x[k] * h[k] - xIm[k] * hIm[k];
+            sumIm[k] += x[k] * hIm[k] + xIm[k] * h[k];
+        }
+    }
+
+    // Real input of up to fftSize samples to a split spectrum
+    static void forward(const juce::dsp::FFT& fft, const float* input, int count, float* frame,
+                        float* spectrum, int numBins) {
+        const int fftSize = fft.getSize();
+        std::copy(input, input + count, frame);
+        std::fill(frame + count, frame + 2 * fftSize, 0.0f);
+
+        fft.performRealOnlyForwardTransform(frame, true);
+
+        for (int k = 0; k < numBins; ++k) {
+            spectrum[k] = frame[2 * k];
+            spectrum[numBins + k] = frame[2 * k + 1];
+        }
+    }
+
+    // Split spectrum back to fftSize real samples in frame
+    static void inverse(const juce::dsp::FFT& fft, const float* spectrum, int numBins, int fftSize, float* frame) {
+        auto* bins = reinterpret_cast<std::complex<float>*>(frame);
+        for (int k = 0; k < numBins; ++k)
+            bins[k] = { spectrum[k], spectrum[numBins + k] };
+
+        // Rebuild the negative frequencies so the inverse sees a Hermitian spectrum
+        for (int k = numBins; k < fftSize; ++k)
+            bins[k] = std::conj(bins[fftSize - k]);
+
+        fft.performRealOnlyInverseTransform(frame);
+    }
+
+    // Takes a finished kernel if the loader has one and has collected the last swap
+    void acquireKernel() {
+        if (pending.load(std::memory_order_relaxed) == nullptr || retired.load(std::memory_order_acquire) != nullptr)
+            return;
+
+        Kernel* next = pending.exchange(nullptr, std::memory_order_acq_rel);
+        if (next == nullptr)
+            return;
+
+        // Built for an earlier sample rate or head size
+        if (next->sampleRate != sampleRate || next->headSize != layout.size || next->numTailPartitions > tailSlots) {
+            retired.store(next, std::memory_order_release);
+            return;
+        }
+
+        retired.store(current, std::memory_order_release);
+        current = next;
+    }
+
+    //==========================================================================
+    // Loader thread
+
+    struct Source {
+        int room = -1;
+        juce::File file;
+        double sampleRate = 0.0;
+        int headSize = 0;
+        int preparation = -1;    // prepare() drops the kernel, even at the same settings
+
+        bool operator== (const Source& other) const {
+            return room == other.room && file == other.file && sampleRate == other.sampleRate
+                && headSize == other.headSize && preparation == other.preparation;
+        }
+    };
+
+    void run() override {
+        Source loaded;
+
+        while (! threadShouldExit()) {
+            delete retired.exchange(nullptr, std::memory_order_acquire);
+
+            const int version = requestVersion.load();
+
+            Source wanted;
+            wanted.room = requestedRoom.load(std::memory_order_relaxed);
+            wanted.file = getFile();
+            wanted.sampleRate = targetSampleRate.load();
+            wanted.headSize = targetHeadSize.load();
+            wanted.preparation = preparationCount.load();
+
+            // The room only matters while no file is loaded
+            if (wanted.file != juce::File())
+                wanted.room = -1;
+
+            if (wanted.sampleRate > 0.0 && ! (wanted == loaded)) {
+                if (auto kernel = createKernel(wanted))
+                    delete pending.exchange(kernel.release(), std::memory_order_acq_rel);
+
+                loaded = wanted;
+            }
+
+            loadedVersion.store(version, std::memory_order_release);
+
+            // A published kernel isn't taken while an old one waits to be deleted
+            const bool swapping = pending.load(std::memory_order_acquire) != nullptr
+                               || retired.load(std::memory_order_acquire) != nullptr;
+
+            if (swapping || active.load(std::memory_order_acquire)) {
+                wait(pollMilliseconds);
+            } else {
+                sleeping.store(true, std::memory_order_release);
+                wait(-1);
+                sleeping.store(false, std::memory_order_release);
+            }
+        }
+    }
+
+    std::unique_ptr<Kernel> createKernel(const Source& source) const {
+        juce::AudioBuffer<float> response;
+
+        if (source.file == juce::File() || ! readFile(source.file, source.sampleRate, response))
+            response = createRoom((Room) juce::jlimit(0, numRooms - 1, source.room), source.sampleRate);
+
+        normalise(response);
+
+        const HeadLayout kernelLayout(source.headSize);
+
+        auto kernel = std::make_unique<Kernel>();
+        kernel->sampleRate = source.sampleRate;
+        kernel->headSize = kernelLayout.size;
+        kernel->length = response.getNumSamples();
+        kernel->numTailPartitions = kernelLayout.getNumTailPartitions(kernel->length);
+
+        juce::dsp::FFT headTransform(kernelLayout.order), tailTransform(tailOrder);
+        std::vector<float> frame((size_t) (2 * tailFftSize));
+
+        for (int c = 0; c < 2; ++c) {
+            const float* samples = response.getReadPointer(juce::jmin(c, response.getNumChannels() - 1));
+            auto& head = kernel->head[(size_t) c];
+            auto& tail = kernel->tail[(size_t) c];
+            head.assign((size_t) (kernelLayout.partitions * 2 * kernelLayout.bins), 0.0f);
+            tail.assign((size_t) (kernel->numTailPartitions * 2 * tailBins), 0.0f);
+
+            for (int p = 0; p < kernelLayout.partitions; ++p) {
+                const int start = p * kernelLayout.size;
+                const int count = juce::jlimit(0, kernelLayout.size, kernel->length - start);
+                forward(headTransform, samples + start, count, frame.data(),
+                        head.data() + p * 2 * kernelLayout.bins, kernelLayout.bins);
+            }
+
+            for (int p = 0; p < kernel->numTailPartitions; ++p) {
+                const int start = kernelLayout.length + p * tailSize;
+                const int count = juce::jlimit(0, tailSize, kernel->length - start);
+                forward(tailTransform, samples + start, count, frame.data(), tail.data() + p * 2 * tailBins, tailBins);
+            }
+        }
+
+        return kernel;
+    }
+
+    // Decodes straight from a memory-mapped file where the format allows it
+    static bool readFile(const juce::File& file, double targetRate, juce::AudioBuffer<float>& response) {
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        std::unique_ptr<juce::AudioFormatReader> reader;
+        if (auto* format = formats.findFormatForFileExtension(file.getFileExtension())) {
+            std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+            if (mapped != nullptr) {
+                const auto length = juce::jmin(mapped->lengthInSamples, (juce::int64) std::ceil(maxImpulseSeconds * mapped->sampleRate));
+                if (mapped->mapSectionOfFile({ 0, length }))
+                    reader = std::move(mapped);
+            }
+        }
+
+        // Compressed formats can't be mapped
+        if (reader == nullptr)
+            reader.reset(formats.createReaderFor(file));
+
+        if (reader == nullptr || reader->sampleRate <= 0.0 || reader->lengthInSamples <= 0)
+            return false;
+
+        const int length = (int) juce::jmin(reader->lengthInSamples, (juce::int64) std::ceil(maxImpulseSeconds * reader->sampleRate));
+        juce::AudioBuffer<float> fileResponse(2, length);
+        reader->read(&fileResponse, 0, length, 0, true, true);
+
+        if (reader->sampleRate == targetRate) {
+            response = std::move(fileResponse);
+            return true;
+        }
+
+        const double ratio = reader->sampleRate / targetRate;
+        const int resampledLength = juce::jmin((int) std::ceil(length / ratio), (int) std::ceil(maxImpulseSeconds * targetRate));
+        response.setSize(2, resampledLength);
+
+        for (int c = 0; c < 2; ++c) {
+            juce::LagrangeInterpolator interpolator;
+            interpolator.process(ratio, fileResponse.getReadPointer(c), response.getWritePointer(c), resampledLength,
+                                 length, 0);
+        }
+
+        return true;
+    }
+
+    // Unit energy in the louder channel, so every response sits at a similar level
+    static void normalise(juce::AudioBuffer<float>& response) {
+        double energy = 0.0;
+        for (int c = 0; c < response.getNumChannels(); ++c) {
+            double channelEnergy = 0.0;
+            const float* samples = response.getReadPointer(c);
+            for (int i = 0; i < response.getNumSamples(); ++i)
+                channelEnergy += (double) samples[i] * samples[i];
+            energy = juce::jmax(energy, channelEnergy);
+        }
+
+        if (energy > 0.0)
+            response.applyGain((float) (1.0 / std::sqrt(energy)));
+    }
+
+    //==========================================================================
+    // Built-in rooms
+
+    static juce::AudioBuffer<float> createRoom(Room type, double rate) {
+        juce::Random random(type == cathedral ? 11 : type == metalTube ? 23 : 5);
+
+        if (type == metalTube) {
+            // About a metre of pipe: strong, slightly stretched harmonics of the
+            // round trip that ring on long after a short metallic burst of noise
+            juce::AudioBuffer<float> response(2, (int) (2.0 * rate));
+            response.clear();
+
+            for (int c = 0; c < 2; ++c) {
+                float* samples = response.getWritePointer(c);
+                addDiffuseTail(samples, response.getNumSamples(), rate, random, 0.002, 0.25, 0.001, 14000.0, 6000.0, 0.5f);
+
+                for (int k = 1; k <= 24; ++k) {
+                    const double frequency = 172.0 * k * std::sqrt(1.0 + 0.0004 * k * k);
+                    if (frequency > 0.45 * rate)
+                        break;
+
+                    const double t60 = 1.6 / std::sqrt((double) k);
+                    const double phase = random.nextDouble() * juce::MathConstants<double>::twoPi;
+                    const float amplitude = 1.0f / std::sqrt((float) k);
+                    addMode(samples, response.getNumSamples(), rate, frequency, phase, t60, amplitude);
+                }
+            }
+
+            return response;
+        }
+
+        // preDelay, t60, build-up, start and end of the treble roll-off, early reflections
+        struct Design { double seconds, preDelay, t60, buildUp, brightCutoff, darkCutoff, earlySpread; int numEarly; };
+        const Design design = type == cathedral
+                                  ? Design { 5.5, 0.030, 4.2, 0.080, 9000.0, 1500.0, 0.120, 24 }
+                                  : Design { 1.2, 0.008, 0.9, 0.010, 12000.0, 4000.0, 0.040, 12 };
+
+        juce::AudioBuffer<float> response(2, (int) (design.seconds * rate));
+        response.clear();
+
+        for (int c = 0; c < 2; ++c) {
+            float* samples = response.getWritePointer(c);
+            const int length = response.getNumSamples();
+
+            addDiffuseTail(samples, length, rate, random, design.preDelay, design.t60, design.buildUp,
+                           design.brightCutoff, design.darkCutoff, 1.0f);
+
+            // Sparse reflections off the nearest walls ahead of the diffuse field
+            for (int e = 0; e < design.numEarly; ++e) {
+                const double time = design.preDelay + random.nextDouble() * design.earlySpread;
+                const int index = juce::jmin(length - 1, (int) (time * rate));
+                const float gain = 3.0f * std::pow(10.0f, (float) (-3.0 * time / design.t60));
+                samples[index] += random.nextBool() ? gain : -gain;
+            }
+        }
+
+        return response;
+    }
+
+    // Noise decaying at t60, with the treble dying away faster than the bass
+    static void addDiffuseTail(float* samples, int length, double rate, juce::Random& random, double preDelay,
+                               double t60, double buildUp, double brightCutoff, double darkCutoff, float level) {
+        const int start = juce::jmin(length, (int) (preDelay * rate));
+        float lowpass = 0.0f;
+        float coefficient = 0.0f;
+
+        for (int i = start; i < length; ++i) {
+            const double t = (i - start) / rate;
+
+            if (((i - start) & 63) == 0) {
+                const double cutoff = darkCutoff + (brightCutoff - darkCutoff) * std::exp(-3.0 * t / t60);
+                coefficient = (float) std::exp(-juce::MathConstants<double>::twoPi * juce::jmin(cutoff, 0.45 * rate) / rate);
+            }
+
+            const float noise = random.nextFloat() * 2.0f - 1.0f;
+            lowpass = noise + coefficient * (lowpass - noise);
+
+            const double envelope = std::pow(10.0, -3.0 * t / t60) * (1.0 - std::exp(-t / buildUp));
+            samples[i] += level * (float) envelope * lowpass;
+        }
+    }
+
+    static void addMode(float* samples, int length, double rate, double frequency, double phase, double t60, float amplitude) {
+        const double step = juce::MathConstants<double>::twoPi * frequency / rate;
+        const double decay = std::pow(10.0, -3.0 / (t60 * rate));
+        double envelope = amplitude;
+
+        for (int i = 0; i < length; ++i) {
+            samples[i] += (float) (envelope * std::sin(phase + step * i));
+            envelope *= decay;
+        }
+    }
+
+    //==========================================================================
+    double sampleRate = 44100.0;
+
+    std::unique_ptr<juce::dsp::FFT> headFft, tailFft;
+    std::vector<float> headFrame, tailFrame, headSum;
+    std::array<Channel, 2> channels;
+    int tailSlots = 1;
+
+    int headSize = 64;
+    HeadLayout layout;
+    std::array<float, maxHeadSize> wetGains {}, dryGains {};
+    int fifoPos = 0;
+    int headSlot = 0;
+    int tailSlot = 0;
+    int tailFill = 0;
+
+    juce::LinearSmoothedValue<float> wetLevel { 0.0f };
+    juce::LinearSmoothedValue<float> dryLevel { 1.0f };
+
+    // Owned by the audio thread, swapped through pending and retired
+    Kernel* current = nullptr;
+    std::atomic<Kernel*> pending { nullptr };
+    std::atomic<Kernel*> retired { nullptr };
+
+    std::atomic<int> requestedRoom { room };
+    std::atomic<int> requestVersion { 0 };     // bumped by every new request
+    std::atomic<int> loadedVersion { -1 };     // the last one the loader has acted on
+    std::atomic<double> targetSampleRate { 0.0 };
+    std::atomic<int> targetHeadSize { 64 };
+    std::atomic<int> preparationCount { 0 };
+    std::atomic<bool> active { false };
+    std::atomic<bool> sleeping { false };
+    juce::CriticalSection fileLock;
+    juce::File requestedFile;
+};
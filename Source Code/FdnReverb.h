@@ -0,0 +1,283 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// 16-line feedback delay network reverb.
+// Each line feeds back through a one-pole damping filter and a gain that sets its
+// decay time, then a 16x16 Hadamard matrix spreads every line into all of the
+// others. The matrix is orthogonal, so the decay time depends on the gains alone.
+// Left input feeds the even lines and right input the odd ones. The two outputs tap
+// every line with orthogonal sign patterns, so they come out decorrelated.
+// The shortest line is always longer than a processing chunk, so nothing written in
+// a chunk is read back within it. A chunk therefore reads every line's delayed
+// samples up front, and the outputs, matrix and input run over contiguous per-line
+// arrays along time, where they vectorise. Only the damping filter is recursive;
+// it runs the 16 lines side by side. All memory is allocated in prepare().
+class FdnReverb {
+public:
+    static constexpr int numLines = 16;
+
+    struct Parameters {
+        float roomSize = 0.5f;      // 0..1, scales the delay lengths
+        float damping = 0.5f;       // 0..1, treble lost on each pass
+        float decaySeconds = 1.8f;  // time to fall by 60 dB
+    };
+
+    void prepare(const juce::dsp::ProcessSpec& spec) {
+        sampleRate = spec.sampleRate;
+
+        const int ringSize = juce::nextPowerOfTwo((int) std::ceil(sampleRate * maxLineSeconds) + maxChunk + 2);
+        ringMask = ringSize - 1;
+        lines.assign((size_t) numLines, std::vector<float>((size_t) ringSize, 0.0f));
+
+        wetLevel.reset(sampleRate, 0.05);
+        dryLevel.reset(sampleRate, 0.05);
+
+        // Designed from scratch for the new rate
+        updateRoomSize(parameters.roomSize);
+        updateDamping(parameters.damping);
+        reset();
+    }
+
+    void reset() {
+        for (auto& line : lines)
+            std::fill(line.begin(), line.end(), 0.0f);
+
+        lowpass.fill(0.0f);
+        delays = targetDelays;
+        gainsNeedUpdate = true;
+        writePos = 0;
+
+        wetLevel.setCurrentAndTargetValue(wetLevel.getTargetValue());
+        dryLevel.setCurrentAndTargetValue(dryLevel.getTargetValue());
+    }
+
+    // Only what has changed is redesigned
+    void setParameters(const Parameters& newParameters) {
+        if (newParameters.roomSize != parameters.roomSize)
+            updateRoomSize(newParameters.roomSize);
+        if (newParameters.damping != parameters.damping)
+            updateDamping(newParameters.damping);
+        if (newParameters.decaySeconds != parameters.decaySeconds)
+            gainsNeedUpdate = true;
+
+        parameters = newParameters;
+    }
+
+    // Ramped over 50 ms
+    void setMix(float newWetLevel, float newDryLevel) {
+        wetLevel.setTargetValue(newWetLevel);
+        dryLevel.setTargetValue(newDryLevel);
+    }
+
+    // Until the last echo is 100 dB down
+    int getTailInSamples() const {
+        const double seconds = juce::jmax(0.0f, parameters.decaySeconds) * 100.0 / 60.0 + maxLineSeconds;
+        return (int) std::ceil(seconds * sampleRate);
+    }
+
+    // Mono or stereo, in place
+    void process(juce::AudioBuffer<float>& buffer) {
+        const int numSamples = buffer.getNumSamples();
+        if (buffer.getNumChannels() <= 0 || lines.empty())
+            return;
+
+        float* left = buffer.getWritePointer(0);
+        float* right = buffer.getNumChannels() > 1 ? buffer.getWritePointer(1) : nullptr;
+
+        for (int start = 0; start < numSamples;) {
+            glideDelays();
+            const int chunk = juce::jmin(numSamples - start, maxChunk, shortestDelay());
+            processChunk(left + start, right != nullptr ? right + start : nullptr, chunk);
+            start += chunk;
+        }
+    }
+
+private:
+    static constexpr int maxChunk = 64;
+    static constexpr double minLineSeconds = 0.02;     // shortest and longest line at full room size
+    static constexpr double maxLineSeconds = 0.1;
+    static constexpr double smallestRoom = 0.3;        // delay scale at room size 0
+
+    // Rows of the 16x16 Hadamard matrix, so both taps and both inputs are orthogonal
+    static float hadamardSign(int row, int line) {
+        int bits = row & line, parity = 0;
+        for (; bits != 0; bits &= bits - 1)
+            parity ^= 1;
+        return parity != 0 ? -1.0f : 1.0f;
+    }
+
+    static bool isPrime(int n) {
+        if (n < 2)
+            return false;
+        for (int d = 2; d * d <= n; ++d)
+            if (n % d == 0)
+                return false;
+        return true;
+    }
+
+    // Geometrically spaced, prime lengths so no two lines share echoes
+    void updateRoomSize(float roomSize) {
+        const double scale = smallestRoom + (1.0 - smallestRoom) * juce::jlimit(0.0f, 1.0f, roomSize);
+
+        for (int l = 0; l < numLines; ++l) {
+            const double seconds = minLineSeconds * std::pow(maxLineSeconds / minLineSeconds, (double) l / (numLines - 1));
+            int length = juce::jmax(2, (int) (seconds * scale * sampleRate));
+            while (! isPrime(length))
+                ++length;
+            targetDelays[(size_t) l] = juce::jmin(length, ringMask - maxChunk);
+        }
+    }
+
+    // Cutoff from 20 kHz (no damping) down to 1 kHz
+    void updateDamping(float damping) {
+        const double cutoff = juce::jmin(20000.0 * std::pow(0.05, (double) juce::jlimit(0.0f, 1.0f, damping)), 0.45 * sampleRate);
+        dampingCoeff = (float) std::exp(-juce::MathConstants<double>::twoPi * cutoff / sampleRate);
+    }
+
+    int shortestDelay() const {
+        int shortest = delays[0];
+        for (const int delay : delays)
+            shortest = juce::jmin(shortest, delay);
+        return juce::jmax(1, shortest);
+    }
+
+    // Lines move towards a new room size a couple of samples per chunk, which
+    // glides the pitch a little instead of clicking
+    void glideDelays() {
+        constexpr int maxStep = 2;
+
+        for (int l = 0; l < numLines; ++l) {
+            const int difference = targetDelays[(size_t) l] - delays[(size_t) l];
+            if (difference != 0) {
+                delays[(size_t) l] += juce::jlimit(-maxStep, maxStep, difference);
+                gainsNeedUpdate = true;
+            }
+        }
+    }
+
+    // Loss per pass for the decay time, with the matrix's 1/4 scaling folded in
+    void updateGains() {
+        const double decaySamples = juce::jmax(0.05f, parameters.decaySeconds) * sampleRate;
+
+        for (int l = 0; l < numLines; ++l)
+            gains[(size_t) l] = 0.25f * (float) std::pow(10.0, -3.0 * delays[(size_t) l] / decaySamples);
+
+        gainsNeedUpdate = false;
+    }
+
+    void processChunk(float* left, float* right, int chunk) {
+        if (gainsNeedUpdate)
+            updateGains();
+
+        const int ringSize = ringMask + 1;
+
+        // Delayed samples of every line, in at most two contiguous runs each
+        for (int l = 0; l < numLines; ++l) {
+            const float* line = lines[(size_t) l].data();
+            const int readPos = (writePos - delays[(size_t) l]) & ringMask;
+            const int firstRun = juce::jmin(chunk, ringSize - readPos);
+            std::copy(line + readPos, line + readPos + firstRun, taps[(size_t) l].begin());
+            std::copy(line, line + (chunk - firstRun), taps[(size_t) l].begin() + firstRun);
+        }
+
+        // Outputs
+        std::fill(wetLeft.begin(), wetLeft.begin() + chunk, 0.0f);
+        std::fill(wetRight.begin(), wetRight.begin() + chunk, 0.0f);
+
+        for (int l = 0; l < numLines; ++l) {
+            const float leftTap = outputScale * hadamardSign(leftRow, l);
+            const float rightTap = outputScale * hadamardSign(rightRow, l);
+            const float* tap = taps[(size_t) l].data();
+
+            for (int i = 0; i < chunk; ++i) {
+                wetLeft[(size_t) i] += leftTap * tap[i];
+                wetRight[(size_t) i] += rightTap * tap[i];
+            }
+        }
+
+        // Damping and decay, the lines side by side
+        for (int i = 0; i < chunk; ++i) {
+            for (int l = 0; l < numLines; ++l) {
+                float& x = taps[(size_t) l][(size_t) i];
+                lowpass[(size_t) l] = x + dampingCoeff * (lowpass[(size_t) l] - x);
+                x = gains[(size_t) l] * lowpass[(size_t) l];
+            }
+        }
+
+        // Fast Walsh-Hadamard transform across the lines, each butterfly over the chunk
+        for (int half = numLines / 2; half >= 1; half /= 2) {
+            for (int l = 0; l < numLines; ++l) {
+                if ((l & half) != 0)
+                    continue;
+
+                float* a = taps[(size_t) l].data();
+                float* b = taps[(size_t) (l + half)].data();
+                for (int i = 0; i < chunk; ++i) {
+                    const float sum = a[i] + b[i];
+                    b[i] = a[i] - b[i];
+                    a[i] = sum;
+                }
+            }
+        }
+
+        // Input, left into the even lines and right into the odd ones
+        const float* rightInput = right != nullptr ? right : left;
+
+        for (int l = 0; l < numLines; ++l) {
+            const float gain = inputScale * hadamardSign(inputRow, l / 2);
+            const float* input = (l & 1) == 0 ? left : rightInput;
+            float* tap = taps[(size_t) l].data();
+
+            for (int i = 0; i < chunk; ++i)
+                tap[i] += gain * input[i];
+        }
+
+        for (int l = 0; l < numLines; ++l) {
+            float* line = lines[(size_t) l].data();
+            const float* tap = taps[(size_t) l].data();
+            const int firstRun = juce::jmin(chunk, ringSize - writePos);
+            std::copy(tap, tap + firstRun, line + writePos);
+            std::copy(tap + firstRun, tap + chunk, line);
+        }
+
+        writePos = (writePos + chunk) & ringMask;
+
+        // Wet/dry mix
+        for (int i = 0; i < chunk; ++i) {
+            const float wet = wetLevel.getNextValue();
+            const float dry = dryLevel.getNextValue();
+            left[i] = dry * left[i] + wet * wetLeft[(size_t) i];
+            if (right != nullptr)
+                right[i] = dry * right[i] + wet * wetRight[(size_t) i];
+        }
+    }
+
+    static constexpr int leftRow = 3;
+    static constexpr int rightRow = 5;
+    static constexpr int inputRow = 6;
+    static constexpr float inputScale = 0.35f;
+    static constexpr float outputScale = 0.25f;
+
+    double sampleRate = 44100.0;
+    Parameters parameters;
+
+    std::vector<std::vector<float>> lines;
+    int ringMask = 0;
+    int writePos = 0;
+
+    std::array<int, numLines> delays {};
+    std::array<int, numLines> targetDelays {};
+    std::array<float, numLines> gains {};
+    std::array<float, numLines> lowpass {};
+    float dampingCoeff = 0.0f;
+    bool gainsNeedUpdate = true;
+
+    juce::LinearSmoothedValue<float> wetLevel { 0.0f };
+    juce::LinearSmoothedValue<float> dryLevel { 1.0f };
+
+    // Chunk scratch, one row per line
+    alignas(32) std::array<std::array<float, maxChunk>, numLines> taps {};
+    alignas(32) std::array<float, maxChunk> wetLeft {};
+    alignas(32) std::array<float, maxChunk> wetRight {};
+};
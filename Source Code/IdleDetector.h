@@ -0,0 +1,86 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Decides once per block which stages of the chain have anything to do.
+// The stages run in series. A stage runs while its input has signal, and for its
+// tail after that: latency, delay lines, filter or reverb decay. Once the tail has
+// run out, its output is silent too, so the stage can be skipped and the next one
+// sees silent input and starts counting down its own tail. Skipped stages always
+// form a run at the front of the chain, and the whole chain is idle once the last
+// stage stops.
+class IdleDetector {
+public:
+    enum Stage {
+        inputStages = 0,    // input gain, low cut
+        pitchAndFormant,    // pitch tracker, pitch and formant shifters
+        voices,
+        outputStages,       // tone, distortion, output gain
+        reverb,
+        numStages
+    };
+
+    // Input peaks at or below this count as silence (-100 dBFS)
+    static constexpr float silenceThreshold = 1.0e-5f;
+
+    void setTailLength(Stage stage, int numSamples) {
+        tailLengths[(size_t) stage] = juce::jmax(0, numSamples);
+        remaining[(size_t) stage] = juce::jmin(remaining[(size_t) stage], tailLengths[(size_t) stage]);
+    }
+
+    int getTailLength(Stage stage) const {
+        return tailLengths[(size_t) stage];
+    }
+
+    // Sum of every stage's tail, the longest the output can outlast the input
+    int getTotalTailLength() const {
+        int total = 0;
+        for (const int length : tailLengths)
+            total += length;
+        return total;
+    }
+
+    // Starts idle, the first block with signal wakes every stage up
+    void reset() {
+        remaining.fill(0);
+        active.fill(false);
+    }
+
+    // Call at the start of each block, with the host's input still in the buffer
+    void process(const juce::AudioBuffer<float>& buffer, int numInputChannels) {
+        const int numSamples = buffer.getNumSamples();
+        const int channels = juce::jmin(numInputChannels, buffer.getNumChannels());
+
+        float peak = 0.0f;
+        for (int channel = 0; channel < channels; ++channel)
+            peak = juce::jmax(peak, buffer.getMagnitude(channel, 0, numSamples));
+
+        bool inputSilent = peak <= silenceThreshold;
+
+        for (size_t stage = 0; stage < (size_t) numStages; ++stage) {
+            if (! inputSilent) {
+                remaining[stage] = tailLengths[stage];
+                active[stage] = true;
+            } else {
+                active[stage] = remaining[stage] > 0;
+                remaining[stage] = juce::jmax(0, remaining[stage] - numSamples);
+            }
+
+            // A skipped stage outputs silence
+            inputSilent = ! active[stage];
+        }
+    }
+
+    bool isActive(Stage stage) const {
+        return active[(size_t) stage];
+    }
+
+    bool isIdle() const {
+        return ! active[(size_t) (numStages - 1)];
+    }
+
+private:
+    std::array<int, numStages> tailLengths {};
+    std::array<int, numStages> remaining {};
+    std::array<bool, numStages> active {};
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+
+// Conversions between interleaved frames, as telephony and VoIP stacks deliver them,
+// and the planar float channels the engine processes. Each is a single pass over
+// the samples. The channel count is a template parameter for mono and stereo, so the
+// stride is a constant and the loops vectorise; other counts take a generic loop.
+// int16 full scale maps to +-1. Going back, samples are rounded and clipped, since
+// the chain can overshoot full scale.
+namespace InterleavedPcm
+{
+    constexpr float int16Scale = 32768.0f;
+
+    inline float toFloat(float sample) { return sample; }
+    inline float toFloat(juce::int16 sample) { return (float) sample * (1.0f / int16Scale); }
+
+    template <typename Sample>
+    Sample fromFloat(float sample);
+
+    template <>
+    inline float fromFloat<float>(float sample) { return sample; }
+
+    // Clips to the int16 range and rounds half away from zero. Float compares would
+    // keep the loops scalar (see ChainStages::Distortion), so the clip is
+    //     (|x - lo| - |x - hi| + lo + hi) / 2
+    // and the rounding takes the sign with copysign, both bit operations.
+    template <>
+    inline juce::int16 fromFloat<juce::int16>(float sample) {
+        const float scaled = sample * int16Scale;
+        const float clipped = 0.5f * (std::abs(scaled + int16Scale) - std::abs(scaled - (int16Scale - 1.0f)) - 1.0f);
+        return (juce::int16) (clipped + std::copysign(0.5f, clipped));
+    }
+
+    template <int numChannels, typename Sample>
+    void deinterleave(const Sample* input, float* const* channels, int numFrames) {
+        for (int c = 0; c < numChannels; ++c) {
+            float* channel = channels[c];
+            for (int i = 0; i < numFrames; ++i)
+                channel[i] = toFloat(input[i * numChannels + c]);
+        }
+    }
+
+    template <int numChannels, typename Sample>
+    void interleave(const float* const* channels, Sample* output, int numFrames) {
+        for (int c = 0; c < numChannels; ++c) {
+            const float* channel = channels[c];
+            for (int i = 0; i < numFrames; ++i)
+                output[i * numChannels + c] = fromFloat<Sample>(channel[i]);
+        }
+    }
+
+    template <typename Sample>
+    void deinterleave(const Sample* input, float* const* channels, int numChannels, int numFrames) {
+        switch (numChannels) {
+            case 1: deinterleave<1>(input, channels, numFrames); break;
+            case 2: deinterleave<2>(input, channels, numFrames); break;
+            default:
+                for (int c = 0; c < numChannels; ++c)
+                    for (int i = 0; i < numFrames; ++i)
+                        channels[c][i] = toFloat(input[i * numChannels + c]);
+                break;
+        }
+    }
+
+    template <typename Sample>
+    void interleave(const float* const* channels, Sample* output, int numChannels, int numFrames) {
+        switch (numChannels) {
+            case 1: interleave<1>(channels, output, numFrames); break;
+            case 2: interleave<2>(channels, output, numFrames); break;
+            default:
+                for (int c = 0; c < numChannels; ++c)
+                    for (int i = 0; i < numFrames; ++i)
+                        output[i * numChannels + c] = fromFloat<Sample>(channels[c][i]);
+                break;
+        }
+    }
+}
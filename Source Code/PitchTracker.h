@@ -0,0 +1,193 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Streaming YIN fundamental-frequency tracker.
+// The input is low-passed and decimated to roughly 11 kHz, then the YIN difference
+// function d(tau) is kept up to date one sample at a time over a sliding window:
+//     d(tau) += (x[t] - x[t - tau])^2 - (x[t - W] - x[t - W - tau])^2
+// so each hop costs O(hop * maxLag) instead of the O(W * maxLag) of a full
+// recomputation. The history is stored newest-first and mirrored, which keeps every
+// lag range contiguous and lets the update loop auto-vectorise.
+class PitchTracker {
+public:
+    struct Estimate {
+        float frequency = 0.0f;   // Hz, last voiced value is held through unvoiced hops
+        float period = 0.0f;      // in host-rate samples
+        float confidence = 0.0f;  // 1 - aperiodicity at the chosen lag, 0..1
+        bool voiced = false;
+    };
+
+    void setFrequencyRange(float newMinFrequency, float newMaxFrequency) {
+        minFrequency = newMinFrequency;
+        maxFrequency = newMaxFrequency;
+    }
+
+    void prepare(const juce::dsp::ProcessSpec& spec) {
+        sampleRate = spec.sampleRate;
+        decimation = juce::jmax(1, (int) (sampleRate / 11025.0 + 0.5));
+        analysisRate = sampleRate / decimation;
+
+        minLag = juce::jmax(2, (int) (analysisRate / maxFrequency));
+        maxLag = juce::jmax(minLag + 2, (int) std::ceil(analysisRate / minFrequency));
+        windowSize = maxLag;
+        hopSize = juce::jmax(1, (int) (analysisRate * 0.0025));
+
+        historySize = windowSize + maxLag + 2;
+        history.assign((size_t) (2 * historySize), 0.0f);
+        difference.assign((size_t) (maxLag + 1), 0.0);
+        normalised.assign((size_t) (maxLag + 1), 0.0f);
+
+        // Two cascaded one-poles at 1 kHz: keeps harmonics that matter for f0
+        // and removes most of what would alias at the decimated rate
+        smoothingCoeff = (float) std::exp(-juce::MathConstants<double>::twoPi * 1000.0 / sampleRate);
+
+        reset();
+    }
+
+    void reset() {
+        std::fill(history.begin(), history.end(), 0.0f);
+        std::fill(difference.begin(), difference.end(), 0.0);
+        std::fill(normalised.begin(), normalised.end(), 1.0f);
+
+        historyPos = 0;
+        windowEnergy = 0.0;
+        decimationCounter = 0;
+        hopCounter = 0;
+        lowpass1 = lowpass2 = 0.0f;
+        estimate = {};
+        estimate.frequency = 150.0f;
+        estimate.period = (float) (sampleRate / 150.0);
+    }
+
+    // Analyses the mono sum of the buffer. The estimate is refreshed every hop.
+    void process(const juce::AudioBuffer<float>& buffer) {
+        const int numChannels = buffer.getNumChannels();
+        const int numSamples = buffer.getNumSamples();
+
+        if (numChannels <= 0 || history.empty())
+            return;
+
+        const float monoScale = 1.0f / (float) numChannels;
+
+        for (int sample = 0; sample < numSamples; ++sample) {
+            float mono = 0.0f;
+            for (int channel = 0; channel < numChannels; ++channel)
+                mono += buffer.getReadPointer(channel)[sample];
+
+            lowpass1 = mono * monoScale + smoothingCoeff * (lowpass1 - mono * monoScale);
+            lowpass2 = lowpass1 + smoothingCoeff * (lowpass2 - lowpass1);
+
+            if (++decimationCounter < decimation)
+                continue;
+
+            decimationCounter = 0;
+            pushAnalysisSample(lowpass2);
+
+            if (++hopCounter >= hopSize) {
+                hopCounter = 0;
+                updateEstimate();
+            }
+        }
+    }
+
+    const Estimate& getEstimate() const {
+        return estimate;
+    }
+
+private:
+    void pushAnalysisSample(float x) {
+        historyPos = historyPos == 0 ? historySize - 1 : historyPos - 1;
+        history[(size_t) historyPos] = x;
+        history[(size_t) (historyPos + historySize)] = x;
+
+        // recent[tau] = x[t - tau], expired[tau] = x[t - W - tau]
+        const float* recent = history.data() + historyPos;
+        const float* expired = recent + windowSize;
+        const float newest = recent[0];
+        const float oldest = expired[0];
+        double* d = difference.data();
+
+        for (int tau = 1; tau <= maxLag; ++tau) {
+            const double added = (double) (newest - recent[tau]);
+            const double removed = (double) (oldest - expired[tau]);
+            d[tau] += added * added - removed * removed;
+        }
+
+        windowEnergy += (double) newest * newest - (double) oldest * oldest;
+    }
+
+    void updateEstimate() {
+        // Cumulative mean normalised difference
+        double runningSum = 0.0;
+        normalised[0] = 1.0f;
+
+        for (int tau = 1; tau <= maxLag; ++tau) {
+            runningSum += juce::jmax(0.0, difference[(size_t) tau]);
+            normalised[(size_t) tau] = runningSum > 0.0
+                ? (float) (juce::jmax(0.0, difference[(size_t) tau]) * tau / runningSum)
+                : 1.0f;
+        }
+
+        // First dip below the threshold, followed down to its local minimum
+        int bestLag = -1;
+        for (int tau = minLag; tau < maxLag; ++tau) {
+            if (normalised[(size_t) tau] < threshold) {
+                while (tau + 1 < maxLag && normalised[(size_t) (tau + 1)] < normalised[(size_t) tau])
+                    ++tau;
+                bestLag = tau;
+                break;
+            }
+        }
+
+        const bool loudEnough = windowEnergy > silenceEnergy * windowSize;
+
+        if (bestLag < 0 || ! loudEnough) {
+            estimate.voiced = false;
+            estimate.confidence = 0.0f;
+            return;
+        }
+
+        // Parabolic interpolation around the minimum for sub-sample lag accuracy
+        const float left = normalised[(size_t) (bestLag - 1)];
+        const float centre = normalised[(size_t) bestLag];
+        const float right = normalised[(size_t) (bestLag + 1)];
+        const float curvature = left - 2.0f * centre + right;
+        const float offset = curvature > 0.0f ? juce::jlimit(-0.5f, 0.5f, 0.5f * (left - right) / curvature) : 0.0f;
+        const float lag = (float) bestLag + offset;
+
+        estimate.frequency = (float) (analysisRate / lag);
+        estimate.period = lag * (float) decimation;
+        estimate.confidence = juce::jlimit(0.0f, 1.0f, 1.0f - centre);
+        estimate.voiced = true;
+    }
+
+    static constexpr float threshold = 0.15f;
+    static constexpr double silenceEnergy = 1.0e-6; // mean square, about -60 dBFS
+
+    float minFrequency = 60.0f;
+    float maxFrequency = 1000.0f;
+
+    double sampleRate = 44100.0;
+    double analysisRate = 11025.0;
+    int decimation = 4;
+    int minLag = 11;
+    int maxLag = 184;
+    int windowSize = 184;
+    int hopSize = 27;
+
+    std::vector<float> history;     // newest first, stored twice back to back
+    std::vector<double> difference;
+    std::vector<float> normalised;
+    int historySize = 0;
+    int historyPos = 0;
+    double windowEnergy = 0.0;
+
+    float smoothingCoeff = 0.0f;
+    float lowpass1 = 0.0f;
+    float lowpass2 = 0.0f;
+    int decimationCounter = 0;
+    int hopCounter = 0;
+
+    Estimate estimate;
+};
@@ -3,7 +3,7 @@
 
 //==============================================================================
 VocalTransformerAudioProcessorEditor::VocalTransformerAudioProcessorEditor (VocalTransformerAudioProcessor& p, juce::AudioProcessorValueTreeState& vts)
-    : AudioProcessorEditor (&p), audioProcessor (p), valueTreeState (vts), currentCharacter(0)
+    : AudioProcessorEditor (&p), audioProcessor (p), valueTreeState (vts)
 {
     // Set custom look and feel
     setLookAndFeel(&modernLookAndFeel);
@@ -13,15 +13,25 @@ VocalTransformerAudioProcessorEditor::VocalTransformerAudioProcessorEditor (Voca
     setupSliders();
     setupLabels();
     setupCharacterSelector();
+    setupQualitySelector();
+    setupDistortionOptions();
+    setupReverbOptions();
     createCharacterIcons();
+    setupAnalysers();
+    
+    // Everything is painted, mostly from the cached background
+    setOpaque(true);
     
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (650, 600);
+    setSize (650, 720);
 }
 
 VocalTransformerAudioProcessorEditor::~VocalTransformerAudioProcessorEditor()
 {
+    stopTimer();
+    audioProcessor.getInputTap().detachReader();
+    audioProcessor.getOutputTap().detachReader();
     setLookAndFeel(nullptr);
 }
 
@@ -74,7 +84,7 @@ void VocalTransformerAudioProcessorEditor::setupSliders()
     
     // Voice count slider
     setupRotarySlider(voiceCountSlider);
-    voiceCountSlider.setRange(1, 4, 1); // Integer steps
+    voiceCountSlider.setRange(1, 64, 1); // Integer steps
     voiceCountAttachment.reset(new juce::AudioProcessorValueTreeState::SliderAttachment(
         valueTreeState, "voice_count", voiceCountSlider));
     
@@ -103,6 +113,30 @@ void VocalTransformerAudioProcessorEditor::setupSliders()
     toneAttachment.reset(new juce::AudioProcessorValueTreeState::SliderAttachment(
         valueTreeState, "tone", toneSlider));
     
+    // Reverb shape sliders - small horizontal bars beside the second row
+    auto setupReverbSlider = [this](juce::Slider& slider)
+    {
+        slider.setSliderStyle(juce::Slider::LinearBar);
+        slider.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 80, 20);
+        slider.setColour(juce::Slider::trackColourId, reverbColour.withAlpha(0.6f));
+        slider.setColour(juce::Slider::textBoxTextColourId, textColour);
+        slider.setColour(juce::Slider::textBoxOutlineColourId, juce::Colours::transparentBlack);
+        addAndMakeVisible(slider);
+    };
+    
+    setupReverbSlider(reverbRoomSizeSlider);
+    reverbRoomSizeAttachment.reset(new juce::AudioProcessorValueTreeState::SliderAttachment(
+        valueTreeState, "reverb_room_size", reverbRoomSizeSlider));
+    
+    setupReverbSlider(reverbDampingSlider);
+    reverbDampingAttachment.reset(new juce::AudioProcessorValueTreeState::SliderAttachment(
+        valueTreeState, "reverb_damping", reverbDampingSlider));
+    
+    setupReverbSlider(reverbDecaySlider);
+    reverbDecaySlider.setTextValueSuffix(" s");
+    reverbDecayAttachment.reset(new juce::AudioProcessorValueTreeState::SliderAttachment(
+        valueTreeState, "reverb_decay", reverbDecaySlider));
+    
     pitchShiftSlider.setColour(juce::Slider::rotarySliderFillColourId, pitchColour);
     formantShiftSlider.setColour(juce::Slider::rotarySliderFillColourId, formantColour);
     voiceCountSlider.setColour(juce::Slider::rotarySliderFillColourId, voicesColour);
@@ -137,6 +171,17 @@ void VocalTransformerAudioProcessorEditor::setupLabels()
     setupLabel(distortionLabel, "Distortion");
     setupLabel(lowCutLabel, "Low Cut");
     setupLabel(toneLabel, "Tone");
+    setupLabel(reverbRoomSizeLabel, "Room");
+    setupLabel(reverbDampingLabel, "Damping");
+    setupLabel(reverbDecayLabel, "Decay");
+    
+    // The reverb shape labels sit to the left of their bars
+    for (auto* label : { &reverbRoomSizeLabel, &reverbDampingLabel, &reverbDecayLabel })
+    {
+        label->setFont(juce::Font(13.0f));
+        label->setJustificationType(juce::Justification::centredLeft);
+        label->setColour(juce::Label::textColourId, reverbColour);
+    }
     
     pitchShiftLabel.setColour(juce::Label::textColourId, pitchColour);
     formantShiftLabel.setColour(juce::Label::textColourId, formantColour);
@@ -174,11 +219,142 @@ void VocalTransformerAudioProcessorEditor::setupCharacterSelector()
     // Add listener to update character image
     characterSelector.onChange = [this]
     {
-        currentCharacter = characterSelector.getSelectedItemIndex();
-        repaint();
+        characterIcon.setCharacter(characterSelector.getSelectedItemIndex());
     };
 }
 
+void VocalTransformerAudioProcessorEditor::setupQualitySelector()
+{
+    // Setup quality mode selector (items match the parameter's choices)
+    qualitySelector.addItem("Low Latency", 1);
+    qualitySelector.addItem("High Quality", 2);
+    
+    qualitySelector.setColour(juce::ComboBox::backgroundColourId, controlBackgroundColour);
+    qualitySelector.setColour(juce::ComboBox::textColourId, textColour);
+    qualitySelector.setColour(juce::ComboBox::arrowColourId, accentColour);
+    qualitySelector.setColour(juce::ComboBox::outlineColourId, juce::Colours::transparentWhite);
+    
+    addAndMakeVisible(qualitySelector);
+    
+    // Latency profile selector (items match the parameter's choices)
+    latencyProfileSelector.addItem("Live", 1);
+    latencyProfileSelector.addItem("Broadcast", 2);
+    latencyProfileSelector.addItem("Offline", 3);
+    
+    latencyProfileSelector.setColour(juce::ComboBox::backgroundColourId, controlBackgroundColour);
+    latencyProfileSelector.setColour(juce::ComboBox::textColourId, textColour);
+    latencyProfileSelector.setColour(juce::ComboBox::arrowColourId, accentColour);
+    latencyProfileSelector.setColour(juce::ComboBox::outlineColourId, juce::Colours::transparentWhite);
+    
+    addAndMakeVisible(latencyProfileSelector);
+    
+    // Reduced rate toggle for the voice band
+    reducedRateButton.setButtonText("Reduced Rate");
+    reducedRateButton.setColour(juce::ToggleButton::textColourId, textColour);
+    reducedRateButton.setColour(juce::ToggleButton::tickColourId, accentColour);
+    
+    addAndMakeVisible(reducedRateButton);
+    
+    // Connect to parameters
+    qualityAttachment.reset(new juce::AudioProcessorValueTreeState::ComboBoxAttachment(
+        valueTreeState, "quality_mode", qualitySelector));
+    latencyProfileAttachment.reset(new juce::AudioProcessorValueTreeState::ComboBoxAttachment(
+        valueTreeState, "latency_profile", latencyProfileSelector));
+    reducedRateAttachment.reset(new juce::AudioProcessorValueTreeState::ButtonAttachment(
+        valueTreeState, "reduced_rate", reducedRateButton));
+}
+
+void VocalTransformerAudioProcessorEditor::setupDistortionOptions()
+{
+    // Oversampling selector (items match the parameter's choices)
+    oversamplingSelector.addItem("No Oversampling", 1);
+    oversamplingSelector.addItem("2x Oversampling", 2);
+    oversamplingSelector.addItem("4x Oversampling", 3);
+    
+    oversamplingSelector.setColour(juce::ComboBox::backgroundColourId, controlBackgroundColour);
+    oversamplingSelector.setColour(juce::ComboBox::textColourId, textColour);
+    oversamplingSelector.setColour(juce::ComboBox::arrowColourId, distortionColour);
+    oversamplingSelector.setColour(juce::ComboBox::outlineColourId, juce::Colours::transparentWhite);
+    
+    addAndMakeVisible(oversamplingSelector);
+    
+    // Antialiasing toggle
+    antialiasButton.setButtonText("Antialias");
+    antialiasButton.setColour(juce::ToggleButton::textColourId, textColour);
+    antialiasButton.setColour(juce::ToggleButton::tickColourId, distortionColour);
+    
+    addAndMakeVisible(antialiasButton);
+    
+    // Connect to parameters
+    oversamplingAttachment.reset(new juce::AudioProcessorValueTreeState::ComboBoxAttachment(
+        valueTreeState, "distortion_oversampling", oversamplingSelector));
+    antialiasAttachment.reset(new juce::AudioProcessorValueTreeState::ButtonAttachment(
+        valueTreeState, "distortion_antialias", antialiasButton));
+}
+
+void VocalTransformerAudioProcessorEditor::setupReverbOptions()
+{
+    // Reverb engine selector (items match the parameter's choices)
+    reverbModeSelector.addItem("Algorithmic", 1);
+    reverbModeSelector.addItem("Convolution", 2);
+    
+    reverbModeSelector.setColour(juce::ComboBox::backgroundColourId, controlBackgroundColour);
+    reverbModeSelector.setColour(juce::ComboBox::textColourId, textColour);
+    reverbModeSelector.setColour(juce::ComboBox::arrowColourId, reverbColour);
+    reverbModeSelector.setColour(juce::ComboBox::outlineColourId, juce::Colours::transparentWhite);
+    
+    addAndMakeVisible(reverbModeSelector);
+    
+    // Impulse response for the convolution reverb
+    impulseResponseButton.setColour(juce::TextButton::buttonColourId, controlBackgroundColour);
+    impulseResponseButton.setColour(juce::TextButton::textColourOffId, reverbColour);
+    impulseResponseButton.onClick = [this] { showImpulseResponseMenu(); };
+    updateImpulseResponseButton();
+    
+    addAndMakeVisible(impulseResponseButton);
+    
+    // Connect to parameter
+    reverbModeAttachment.reset(new juce::AudioProcessorValueTreeState::ComboBoxAttachment(
+        valueTreeState, "reverb_mode", reverbModeSelector));
+}
+
+void VocalTransformerAudioProcessorEditor::showImpulseResponseMenu()
+{
+    juce::PopupMenu menu;
+    menu.addItem(1, "Load Impulse Response...");
+    menu.addItem(2, "Use Character Room", audioProcessor.getImpulseResponseFile() != juce::File());
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&impulseResponseButton), [this](int result)
+    {
+        if (result == 2)
+        {
+            audioProcessor.loadImpulseResponse({});
+            updateImpulseResponseButton();
+        }
+        else if (result == 1)
+        {
+            impulseResponseChooser = std::make_unique<juce::FileChooser>("Load Impulse Response", juce::File(),
+                                                                         "*.wav;*.aif;*.aiff;*.flac");
+            
+            impulseResponseChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                                [this](const juce::FileChooser& chooser)
+            {
+                if (chooser.getResult() != juce::File())
+                {
+                    audioProcessor.loadImpulseResponse(chooser.getResult());
+                    updateImpulseResponseButton();
+                }
+            });
+        }
+    });
+}
+
+void VocalTransformerAudioProcessorEditor::updateImpulseResponseButton()
+{
+    const auto file = audioProcessor.getImpulseResponseFile();
+    impulseResponseButton.setButtonText(file != juce::File() ? file.getFileNameWithoutExtension() : "Character Room");
+}
+
 void VocalTransformerAudioProcessorEditor::createCharacterIcons()
 {
     // Create simple path icons for each character type
@@ -190,7 +366,7 @@ void VocalTransformerAudioProcessorEditor::createCharacterIcons()
     normalPath.addEllipse(60, 30, 15, 15);
     normalPath.startNewSubPath(30, 65);
     normalPath.quadraticTo(50, 85, 70, 65);
-    characterIcons[0] = normalPath;
+    characterIcon.setIcon(0, normalPath, strengthColour);
     
     // Robot
     juce::Path robotPath;
@@ -198,7 +374,7 @@ void VocalTransformerAudioProcessorEditor::createCharacterIcons()
     robotPath.addRectangle(25, 30, 15, 15);
     robotPath.addRectangle(60, 30, 15, 15);
     robotPath.addRectangle(30, 65, 40, 10);
-    characterIcons[1] = robotPath;
+    characterIcon.setIcon(1, robotPath, pitchColour);
     
     // Alien
     juce::Path alienPath;
@@ -207,7 +383,7 @@ void VocalTransformerAudioProcessorEditor::createCharacterIcons()
     alienPath.addEllipse(60, 30, 10, 20);
     alienPath.startNewSubPath(40, 65);
     alienPath.quadraticTo(50, 75, 60, 65);
-    characterIcons[2] = alienPath;
+    characterIcon.setIcon(2, alienPath, formantColour);
     
     // Child
     juce::Path childPath;
@@ -216,7 +392,7 @@ void VocalTransformerAudioProcessorEditor::createCharacterIcons()
     childPath.addEllipse(55, 30, 10, 10);
     childPath.startNewSubPath(40, 50);
     childPath.quadraticTo(50, 65, 60, 50);
-    characterIcons[3] = childPath;
+    characterIcon.setIcon(3, childPath, voicesColour);
     
     // Giant
     juce::Path giantPath;
@@ -225,7 +401,7 @@ void VocalTransformerAudioProcessorEditor::createCharacterIcons()
     giantPath.addRectangle(55, 20, 20, 10);
     giantPath.startNewSubPath(30, 65);
     giantPath.lineTo(70, 65);
-    characterIcons[4] = giantPath;
+    characterIcon.setIcon(4, giantPath, detuneColour);
     
     // Elder
     juce::Path elderPath;
@@ -234,7 +410,7 @@ void VocalTransformerAudioProcessorEditor::createCharacterIcons()
     elderPath.addEllipse(55, 30, 8, 5);
     elderPath.startNewSubPath(35, 70);
     elderPath.quadraticTo(50, 60, 65, 70);
-    characterIcons[5] = elderPath;
+    characterIcon.setIcon(5, elderPath, distortionColour);
     
     // Choir
     juce::Path choirPath;
@@ -242,18 +418,77 @@ void VocalTransformerAudioProcessorEditor::createCharacterIcons()
     choirPath.addEllipse(10, 20, 30, 40);
     choirPath.addEllipse(35, 10, 30, 40);
     choirPath.addEllipse(60, 20, 30, 40);
-    characterIcons[6] = choirPath;
+    characterIcon.setIcon(6, choirPath, reverbColour);
     
-    // Center each path around the origin
-    for (auto& pair : characterIcons) {
-        auto bounds = pair.second.getBounds();
-        pair.second.applyTransform(juce::AffineTransform::translation(-bounds.getCentreX(), -bounds.getCentreY()));
-    }
+    // The attachment has already picked the character, before onChange was set
+    characterIcon.setCharacter(characterSelector.getSelectedItemIndex());
+    addAndMakeVisible(characterIcon);
+}
+
+void VocalTransformerAudioProcessorEditor::setupAnalysers()
+{
+    addAndMakeVisible(inputSpectrogram);
+    addAndMakeVisible(outputSpectrogram);
+    addAndMakeVisible(inputMeter);
+    addAndMakeVisible(outputMeter);
+    
+    // Room for everything the taps can hold, so the timer never allocates
+    tapLeft.resize(AudioTap::capacity);
+    tapRight.resize(AudioTap::capacity);
+    
+    audioProcessor.getInputTap().attachReader();
+    audioProcessor.getOutputTap().attachReader();
+    startTimerHz(30);
+}
+
+void VocalTransformerAudioProcessorEditor::updateAnalyser(AudioTap& tap, Spectrogram& spectrogram, LevelMeter& meter)
+{
+    spectrogram.setSampleRate(tap.getSampleRate());
+    
+    const int numSamples = tap.pull({ tapLeft.data(), tapRight.data() }, AudioTap::capacity);
+    meter.addSamples(tapLeft.data(), tapRight.data(), numSamples);
+    
+    // The spectrogram shows both channels mixed
+    for (int i = 0; i < numSamples; ++i)
+        tapLeft[(size_t)i] = 0.5f * (tapLeft[(size_t)i] + tapRight[(size_t)i]);
+    
+    spectrogram.pushSamples(tapLeft.data(), numSamples);
+    
+    // Each repaints its own bounds, and only when something has changed
+    spectrogram.update();
+    meter.update();
+}
+
+void VocalTransformerAudioProcessorEditor::timerCallback()
+{
+    updateAnalyser(audioProcessor.getInputTap(), inputSpectrogram, inputMeter);
+    updateAnalyser(audioProcessor.getOutputTap(), outputSpectrogram, outputMeter);
 }
 
 //==============================================================================
 void VocalTransformerAudioProcessorEditor::paint (juce::Graphics& g)
 {
+    // Sliders aren't opaque, so this runs under every knob that moves; keep it to a blit
+    const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (! backgroundImage.isValid() || scale != backgroundScale)
+    {
+        backgroundImage = renderBackground(scale);
+        backgroundScale = scale;
+    }
+    
+    g.drawImage(backgroundImage, getLocalBounds().toFloat());
+}
+
+juce::Image VocalTransformerAudioProcessorEditor::renderBackground(float scale) const
+{
+    juce::Image image(juce::Image::RGB,
+                      juce::jmax(1, juce::roundToInt((float)getWidth() * scale)),
+                      juce::jmax(1, juce::roundToInt((float)getHeight() * scale)),
+                      false);
+    
+    juce::Graphics g(image);
+    g.addTransform(juce::AffineTransform::scale(scale));
+    
     // Fill the background
     g.fillAll(backgroundColour);
     
@@ -262,49 +497,36 @@ void VocalTransformerAudioProcessorEditor::paint (juce::Graphics& g)
     g.setColour(textColour);
     g.drawText("Vocal Transformer", 20, 15, getWidth() - 40, 30, juce::Justification::centred);
     
-    // Draw character icon if available
-    if (characterIcons.find(currentCharacter) != characterIcons.end()) {
-        
-        switch (currentCharacter) {
-                case 0: g.setColour(strengthColour); break;      // Normal - white
-                case 1: g.setColour(pitchColour); break;         // Robot - blue
-                case 2: g.setColour(formantColour); break;       // Alien - purple
-                case 3: g.setColour(voicesColour); break;        // Child - cyan
-                case 4: g.setColour(detuneColour); break;        // Giant - orange
-                case 5: g.setColour(distortionColour); break;    // Elder - red
-                case 6: g.setColour(reverbColour); break;        // Choir - blue-purple
-                default: g.setColour(accentColour);
-            }
-        
-        // Get character icon and scale it to fit
-        auto path = characterIcons[currentCharacter];
-        float iconSize = 60.0f;
-        
-        // Calculate icon position
-        float xPos = (getWidth() - iconSize) / 2;
-        float yPos = 60;
-        
-        // Scale and translate the path to the desired location and size
-        auto bounds = path.getBounds();
-        float scale = iconSize / juce::jmax(bounds.getWidth(), bounds.getHeight());
-        
-        path.applyTransform(juce::AffineTransform::scale(scale)
-                           .translated(xPos + iconSize/2, yPos + iconSize/2));
-        
-        // Draw the icon
-        g.fillPath(path);
-    }
-    
     // Draw divider line
     g.setColour(accentColour.withAlpha(0.5f));
     g.drawLine(20, 130, getWidth() - 20, 130, 1.0f);
+    
+    // Analyser captions and divider
+    g.drawLine(20, 582, getWidth() - 20, 582, 1.0f);
+    g.setFont(juce::Font(13.0f));
+    g.setColour(textColour);
+    g.drawText("Input", inputSpectrogram.getX(), 586, 100, 18, juce::Justification::centredLeft);
+    g.drawText("Output", outputSpectrogram.getX(), 586, 100, 18, juce::Justification::centredLeft);
+    
+    return image;
 }
 
 void VocalTransformerAudioProcessorEditor::resized()
 {
+    // Redrawn at the next paint, with the captions in their new places
+    backgroundImage = {};
+    
+    // Character icon (top centre)
+    characterIcon.setBounds((getWidth() - 60) / 2, 60, 60, 60);
+    
     // Character selector (top)
     characterSelector.setBounds((getWidth() - 250) / 2, 140, 250, 30);
     
+    // Quality mode selector (top right, kept above the divider)
+    qualitySelector.setBounds(getWidth() - 150, 60, 130, 22);
+    latencyProfileSelector.setBounds(getWidth() - 150, 86, 130, 20);
+    reducedRateButton.setBounds(getWidth() - 150, 108, 130, 20);
+    
     // Character strength slider
     characterStrengthSlider.setBounds((getWidth() - 100) / 2, 180, 100, 100);
     characterStrengthLabel.setBounds((getWidth() - 100) / 2, 270, 100, 25);
@@ -346,4 +568,32 @@ void VocalTransformerAudioProcessorEditor::resized()
     distortionLabel.setBounds(row2StartX, row2Y + sliderHeight, sliderWidth, labelHeight);
     lowCutLabel.setBounds(row2StartX + sliderWidth + sliderSpacing, row2Y + sliderHeight, sliderWidth, labelHeight);
     toneLabel.setBounds(row2StartX + (sliderWidth + sliderSpacing) * 2, row2Y + sliderHeight, sliderWidth, labelHeight);
+    
+    // Distortion options (left of the distortion slider)
+    oversamplingSelector.setBounds(row2StartX - 160, row2Y + 20, 140, 26);
+    antialiasButton.setBounds(row2StartX - 160, row2Y + 52, 140, 24);
+    
+    // Reverb engine and impulse response (top left)
+    reverbModeSelector.setBounds(20, 60, 130, 22);
+    impulseResponseButton.setBounds(20, 86, 130, 20);
+    
+    // Reverb shape (right of the tone slider)
+    int reverbX = row2StartX + row2Width + 20;
+    reverbRoomSizeLabel.setBounds(reverbX, row2Y + 8, 60, 22);
+    reverbRoomSizeSlider.setBounds(reverbX + 60, row2Y + 8, 80, 22);
+    reverbDampingLabel.setBounds(reverbX, row2Y + 38, 60, 22);
+    reverbDampingSlider.setBounds(reverbX + 60, row2Y + 38, 80, 22);
+    reverbDecayLabel.setBounds(reverbX, row2Y + 68, 60, 22);
+    reverbDecaySlider.setBounds(reverbX + 60, row2Y + 68, 80, 22);
+    
+    // Spectrograms with their meters (bottom)
+    int analyserY = 606;
+    int analyserHeight = 100;
+    int meterWidth = 16;
+    int analyserWidth = (getWidth() - 40 - 20) / 2 - meterWidth - 4;
+    
+    inputSpectrogram.setBounds(20, analyserY, analyserWidth, analyserHeight);
+    inputMeter.setBounds(inputSpectrogram.getRight() + 4, analyserY, meterWidth, analyserHeight);
+    outputSpectrogram.setBounds(inputMeter.getRight() + 20, analyserY, analyserWidth, analyserHeight);
+    outputMeter.setBounds(outputSpectrogram.getRight() + 4, analyserY, meterWidth, analyserHeight);
 }
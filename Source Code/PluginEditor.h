@@ -2,6 +2,8 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "AnalyserComponents.h"
+#include "CharacterIcon.h"
 
 // Custom LookAndFeel class for modern appearance
 class ModernLookAndFeel : public juce::LookAndFeel_V4
@@ -32,13 +34,10 @@ public:
         // Calculate rotation angle
         const float angle = rotaryStartAngle + sliderPos * (rotaryEndAngle - rotaryStartAngle);
         
-        // Background circle
-        g.setColour(slider.findColour(juce::Slider::rotarySliderOutlineColourId));
-        g.fillEllipse(rx, ry, rw, rw);
-        
-        // Outer ring
-        g.setColour(juce::Colour(60, 60, 60));
-        g.drawEllipse(rx, ry, rw, rw, 1.0f);
+        // Background circle and outer ring, from the cache
+        const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+        g.drawImage(getKnobBody(radius, slider.findColour(juce::Slider::rotarySliderOutlineColourId), scale),
+                    juce::Rectangle<float>(rx - 1.0f, ry - 1.0f, rw + 2.0f, rw + 2.0f));
         
         // Draw filled arc for value
         if (radius > 12.0f)
@@ -67,12 +66,44 @@ public:
             g.fillEllipse(centerX - 4.0f, centerY - 4.0f, 8.0f, 8.0f);
         }
     }
+    
+private:
+    // The parts of a knob that don't move with its value, rendered once per knob
+    // size, colour and display scale. There are only a few distinct knob sizes, so
+    // the cache stays small.
+    const juce::Image& getKnobBody(float radius, juce::Colour colour, float scale)
+    {
+        const auto key = std::make_tuple(juce::roundToInt(radius), colour.getARGB(), juce::roundToInt(scale * 100.0f));
+        auto& image = knobBodies[key];
+        
+        if (! image.isValid())
+        {
+            // One pixel of margin for the ring's stroke
+            const float size = juce::jmax(0.0f, radius) * 2.0f + 2.0f;
+            const int pixels = juce::jmax(1, (int)std::ceil(size * scale));
+            image = juce::Image(juce::Image::ARGB, pixels, pixels, true);
+            
+            juce::Graphics ig(image);
+            ig.addTransform(juce::AffineTransform::scale((float)pixels / size));
+            
+            ig.setColour(colour);
+            ig.fillEllipse(1.0f, 1.0f, size - 2.0f, size - 2.0f);
+            
+            ig.setColour(juce::Colour(60, 60, 60));
+            ig.drawEllipse(1.0f, 1.0f, size - 2.0f, size - 2.0f, 1.0f);
+        }
+        
+        return image;
+    }
+    
+    std::map<std::tuple<int, juce::uint32, int>, juce::Image> knobBodies;
 };
 
 //==============================================================================
 /**
 */
-class VocalTransformerAudioProcessorEditor  : public juce::AudioProcessorEditor
+class VocalTransformerAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                              private juce::Timer
 {
 public:
     VocalTransformerAudioProcessorEditor (VocalTransformerAudioProcessor&, juce::AudioProcessorValueTreeState& vts);
@@ -104,6 +135,14 @@ private:
     
     // GUI Components
     juce::ComboBox characterSelector;
+    juce::ComboBox qualitySelector;
+    juce::ComboBox latencyProfileSelector;
+    juce::ToggleButton reducedRateButton;
+    juce::ComboBox oversamplingSelector;
+    juce::ToggleButton antialiasButton;
+    juce::ComboBox reverbModeSelector;
+    juce::TextButton impulseResponseButton;
+    std::unique_ptr<juce::FileChooser> impulseResponseChooser;
     juce::Slider characterStrengthSlider;
     juce::Slider pitchShiftSlider;
     juce::Slider formantShiftSlider;
@@ -113,6 +152,19 @@ private:
     juce::Slider distortionSlider;
     juce::Slider lowCutSlider;
     juce::Slider toneSlider;
+    juce::Slider reverbRoomSizeSlider;
+    juce::Slider reverbDampingSlider;
+    juce::Slider reverbDecaySlider;
+    
+    // Live input and output analysis, fed from the processor's audio taps
+    Spectrogram inputSpectrogram { juce::Colour(70, 130, 200) };
+    Spectrogram outputSpectrogram { juce::Colour(180, 100, 220) };
+    LevelMeter inputMeter { juce::Colour(70, 130, 200) };
+    LevelMeter outputMeter { juce::Colour(180, 100, 220) };
+    std::vector<float> tapLeft, tapRight;
+    
+    // Picture of the selected character, repainted only when it changes
+    CharacterIcon characterIcon { juce::Colour(25, 25, 30) };
     
     // Labels
     juce::Label characterLabel;
@@ -125,9 +177,18 @@ private:
     juce::Label distortionLabel;
     juce::Label lowCutLabel;
     juce::Label toneLabel;
+    juce::Label reverbRoomSizeLabel;
+    juce::Label reverbDampingLabel;
+    juce::Label reverbDecayLabel;
     
     // Parameter attachments - these connect our GUI controls to parameters
     std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> characterAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> qualityAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> latencyProfileAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> reducedRateAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> oversamplingAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> antialiasAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> reverbModeAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> characterStrengthAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> pitchShiftAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> formantShiftAttachment;
@@ -137,10 +198,13 @@ private:
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> distortionAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> lowCutAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> toneAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> reverbRoomSizeAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> reverbDampingAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> reverbDecayAttachment;
     
-    // Character icons for visualization
-    std::map<int, juce::Path> characterIcons;
-    int currentCharacter;
+    // Background, title and dividers, rendered once per size and display scale
+    juce::Image backgroundImage;
+    float backgroundScale = 0.0f;
     
     // Custom colors
     juce::Colour backgroundColour;
@@ -153,7 +217,16 @@ private:
     void setupSliders();
     void setupLabels();
     void setupCharacterSelector();
+    void setupQualitySelector();
+    void setupDistortionOptions();
+    void setupReverbOptions();
+    void showImpulseResponseMenu();
+    void updateImpulseResponseButton();
     void createCharacterIcons();
+    juce::Image renderBackground(float scale) const;
+    void setupAnalysers();
+    void updateAnalyser(AudioTap& tap, Spectrogram& spectrogram, LevelMeter& meter);
+    void timerCallback() override;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VocalTransformerAudioProcessorEditor)
 };
@@ -8,10 +8,20 @@ const juce::String VocalTransformerAudioProcessor::FORMANT_SHIFT_ID = "formant_s
 const juce::String VocalTransformerAudioProcessor::VOICE_COUNT_ID = "voice_count";
 const juce::String VocalTransformerAudioProcessor::DETUNE_ID = "detune";
 const juce::String VocalTransformerAudioProcessor::REVERB_ID = "reverb";
+const juce::String VocalTransformerAudioProcessor::REVERB_ROOM_SIZE_ID = "reverb_room_size";
+const juce::String VocalTransformerAudioProcessor::REVERB_DAMPING_ID = "reverb_damping";
+const juce::String VocalTransformerAudioProcessor::REVERB_DECAY_ID = "reverb_decay";
+const juce::String VocalTransformerAudioProcessor::REVERB_MODE_ID = "reverb_mode";
+const juce::String VocalTransformerAudioProcessor::IMPULSE_RESPONSE_FILE_ID = "impulse_response_file";
 const juce::String VocalTransformerAudioProcessor::CHARACTER_STRENGTH_ID = "character_strength";
 const juce::String VocalTransformerAudioProcessor::DISTORTION_ID = "distortion";
 const juce::String VocalTransformerAudioProcessor::LOW_CUT_ID = "low_cut";
 const juce::String VocalTransformerAudioProcessor::TONE_ID = "tone";
+const juce::String VocalTransformerAudioProcessor::QUALITY_MODE_ID = "quality_mode";
+const juce::String VocalTransformerAudioProcessor::DISTORTION_OVERSAMPLING_ID = "distortion_oversampling";
+const juce::String VocalTransformerAudioProcessor::DISTORTION_ANTIALIAS_ID = "distortion_antialias";
+const juce::String VocalTransformerAudioProcessor::LATENCY_PROFILE_ID = "latency_profile";
+const juce::String VocalTransformerAudioProcessor::REDUCED_RATE_ID = "reduced_rate";
 
 //==============================================================================
 VocalTransformerAudioProcessor::VocalTransformerAudioProcessor()
@@ -21,80 +31,19 @@ VocalTransformerAudioProcessor::VocalTransformerAudioProcessor()
                        ),
        parameters(*this, nullptr, "PARAMETERS", createParameterLayout())
 {
-    initializeCharacterPresets();
+    // The engine reads the parameter tree's values directly, its IDs are the same
+    for (int i = 0; i < NUM_PARAMETERS; ++i)
+    {
+        const auto parameter = (EngineParameter)i;
+        auto* value = parameters.getRawParameterValue(VocalTransformerEngine::getParameterInfo(parameter).id);
+        jassert(value != nullptr);
+        engine.bindParameter(parameter, value);
+    }
 }
 
 VocalTransformerAudioProcessor::~VocalTransformerAudioProcessor()
 {
-}
-
-void VocalTransformerAudioProcessor::initializeCharacterPresets()
-{
-    // Normal voice
-    characterPresets[NORMAL] = { 0.0f, 0.5f, 1, 0.0f, 0.2f };
-    
-    // Robot voice
-    characterPresets[ROBOT] = { -2.0f, 0.5f, 1, 0.0f, 0.1f };
-    
-    // Alien voice
-    characterPresets[ALIEN] = { 3.0f, 0.7f, 2, 0.7f, 0.6f };
-    
-    // Child voice
-    characterPresets[CHILD] = { 4.0f, 0.8f, 1, 0.2f, 0.3f };
-    
-    // Giant voice
-    characterPresets[GIANT] = { -6.0f, 0.2f, 1, 0.0f, 0.5f };
-    
-    // Elder voice
-    characterPresets[ELDER] = { -1.0f, 0.3f, 1, 0.3f, 0.4f };
-    
-    // Choir voice
-    characterPresets[CHOIR] = { 0.0f, 0.5f, 4, 0.4f, 0.8f };
-}
-
-void VocalTransformerAudioProcessor::applyCharacterPreset(int characterIndex, float strength)
-{
-    if (characterIndex < 0 || characterIndex >= NUM_CHARACTERS)
-        return;
-        
-    auto& preset = characterPresets[characterIndex];
-    
-    // These calls get the parameter objects from the value tree state
-    auto* pitchParam = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(PITCH_SHIFT_ID));
-    auto* formantParam = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(FORMANT_SHIFT_ID));
-    auto* voiceCountParam = dynamic_cast<juce::AudioParameterInt*>(parameters.getParameter(VOICE_COUNT_ID));
-    auto* detuneParam = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(DETUNE_ID));
-    auto* reverbParam = dynamic_cast<juce::AudioParameterFloat*>(parameters.getParameter(REVERB_ID));
-    
-    // Apply the preset values with strength factor
-    if (pitchParam)
-        *pitchParam = pitchParam->getNormalisableRange().convertFrom0to1(
-            juce::jmap(strength, 0.0f, 1.0f,
-                      pitchParam->getNormalisableRange().convertTo0to1(pitchParam->get()),
-                      pitchParam->getNormalisableRange().convertTo0to1(preset.pitchShift)));
-                      
-    if (formantParam)
-        *formantParam = formantParam->getNormalisableRange().convertFrom0to1(
-            juce::jmap(strength, 0.0f, 1.0f,
-                      formantParam->getNormalisableRange().convertTo0to1(formantParam->get()),
-                      formantParam->getNormalisableRange().convertTo0to1(preset.formantShift)));
-                      
-    if (voiceCountParam)
-        *voiceCountParam = (int)juce::jmap(strength, 0.0f, 1.0f,
-                                     (float)voiceCountParam->get(),
-                                     (float)preset.voiceCount);
-                                     
-    if (detuneParam)
-        *detuneParam = detuneParam->getNormalisableRange().convertFrom0to1(
-            juce::jmap(strength, 0.0f, 1.0f,
-                      detuneParam->getNormalisableRange().convertTo0to1(detuneParam->get()),
-                      detuneParam->getNormalisableRange().convertTo0to1(preset.detune)));
-                      
-    if (reverbParam)
-        *reverbParam = reverbParam->getNormalisableRange().convertFrom0to1(
-            juce::jmap(strength, 0.0f, 1.0f,
-                      reverbParam->getNormalisableRange().convertTo0to1(reverbParam->get()),
-                      reverbParam->getNormalisableRange().convertTo0to1(preset.reverb)));
+    cancelPendingUpdate();
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout VocalTransformerAudioProcessor::createParameterLayout()
@@ -126,11 +75,11 @@ juce::AudioProcessorValueTreeState::ParameterLayout VocalTransformerAudioProcess
         "Formant Shift",
         0.0f, 1.0f, 0.5f)); // Default to normal
     
-    // Voice count (1 to 4 voices)
+    // Voice count (1 to 64 voices; above 4 it becomes a choir ensemble)
     params.push_back(std::make_unique<juce::AudioParameterInt>(
         juce::ParameterID{VOICE_COUNT_ID, 1},
         "Voice Count",
-        1, 4, 1)); // Default to 1 voice
+        1, 64, 1)); // Default to 1 voice
     
     // Detune amount (0.0 to 1.0)
     params.push_back(std::make_unique<juce::AudioParameterFloat>(
@@ -144,6 +93,32 @@ juce::AudioProcessorValueTreeState::ParameterLayout VocalTransformerAudioProcess
         "Reverb",
         0.0f, 1.0f, 0.2f)); // Default to slight reverb
     
+    // Reverb room size (0.0 to 1.0)
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        juce::ParameterID{REVERB_ROOM_SIZE_ID, 1},
+        "Reverb Room Size",
+        0.0f, 1.0f, 0.5f)); // Default to a medium room
+    
+    // Reverb damping (0.0 to 1.0)
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        juce::ParameterID{REVERB_DAMPING_ID, 1},
+        "Reverb Damping",
+        0.0f, 1.0f, 0.5f)); // Default to moderate damping
+    
+    // Reverb decay time (0.2 to 10 seconds, skewed towards short decays)
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(
+        juce::ParameterID{REVERB_DECAY_ID, 1},
+        "Reverb Decay",
+        juce::NormalisableRange<float>(0.2f, 10.0f, 0.01f, 0.4f),
+        1.8f)); // Default to 1.8 seconds
+    
+    // Reverb engine (feedback delay network or convolution)
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID{REVERB_MODE_ID, 1},
+        "Reverb Mode",
+        juce::StringArray("Algorithmic", "Convolution"),
+        REVERB_ALGORITHMIC)); // Default to the algorithmic reverb
+    
     // Distortion amount (0.0 to 1.0)
     params.push_back(std::make_unique<juce::AudioParameterFloat>(
         juce::ParameterID{DISTORTION_ID, 1},
@@ -162,6 +137,41 @@ juce::AudioProcessorValueTreeState::ParameterLayout VocalTransformerAudioProcess
         "Tone",
         0.0f, 1.0f, 0.5f)); // Default to middle
     
+    // Quality mode (time-domain low latency or spectral high quality)
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID{QUALITY_MODE_ID, 1},
+        "Quality Mode",
+        juce::StringArray("Low Latency", "High Quality"),
+        LOW_LATENCY)); // Default to low latency
+    
+    // Distortion oversampling (off, 2x, 4x)
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID{DISTORTION_OVERSAMPLING_ID, 1},
+        "Distortion Oversampling",
+        juce::StringArray("Off", "2x", "4x"),
+        OVERSAMPLING_2X)); // Default to 2x
+    
+    // Antiderivative antialiasing for the distortion
+    params.push_back(std::make_unique<juce::AudioParameterBool>(
+        juce::ParameterID{DISTORTION_ANTIALIAS_ID, 1},
+        "Distortion Antialiasing",
+        true)); // Default to on
+    
+    // Latency profile - changes the latency, so hosts can't automate it
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID{LATENCY_PROFILE_ID, 1},
+        "Latency Profile",
+        juce::StringArray("Live", "Broadcast", "Offline"),
+        PROFILE_BROADCAST, // Default to the standard windows
+        juce::AudioParameterChoiceAttributes().withAutomatable(false)));
+    
+    // Pitch, formant and voices on the voice band at ~24 kHz - changes the latency too
+    params.push_back(std::make_unique<juce::AudioParameterBool>(
+        juce::ParameterID{REDUCED_RATE_ID, 1},
+        "Reduced Rate Voice Band",
+        false, // Default to the full rate
+        juce::AudioParameterBoolAttributes().withAutomatable(false)));
+    
     return { params.begin(), params.end() };
 }
 
@@ -188,7 +198,7 @@ bool VocalTransformerAudioProcessor::isMidiEffect() const
 
 double VocalTransformerAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    return engine.getTailLengthSeconds();
 }
 
 int VocalTransformerAudioProcessor::getNumPrograms()
@@ -220,25 +230,31 @@ void VocalTransformerAudioProcessor::changeProgramName (int index, const juce::S
 //==============================================================================
 void VocalTransformerAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Prepare DSP modules
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = samplesPerBlock;
-    spec.numChannels = getTotalNumOutputChannels();
+    engine.prepare(sampleRate, samplesPerBlock, getTotalNumOutputChannels());
+    setLatencySamples(engine.getLatencySamples());
     
-    inputGain.prepare(spec);
-    outputGain.prepare(spec);
-    pitchShifter.prepare(spec);
-    formantShifter.prepare(spec);
-    voiceMultiplier.prepare(spec);
+    inputTap.prepare(sampleRate);
+    outputTap.prepare(sampleRate);
+}
+
+void VocalTransformerAudioProcessor::handleAsyncUpdate()
+{
+    // Buffers are resized for a new profile, with processing held off meanwhile.
+    // prepareToPlay() reports the new latency.
+    if (engine.isPrepareNeeded() && getSampleRate() > 0.0)
+    {
+        suspendProcessing(true);
+        prepareToPlay(getSampleRate(), getBlockSize());
+        suspendProcessing(false);
+        return;
+    }
     
-    // Set up reverb
-    reverb.reset();
-    reverb.setSampleRate(sampleRate);
+    if (engine.isLoaderNeeded())
+        engine.startLoader();
     
-    // Set default gain
-    inputGain.setGainLinear(0.9f);
-    outputGain.setGainLinear(1.0f);
+    // The host hears about it here rather than from the audio thread
+    if (engine.getLatencySamples() != getLatencySamples())
+        setLatencySamples(engine.getLatencySamples());
 }
 
 void VocalTransformerAudioProcessor::releaseResources()
@@ -262,172 +278,28 @@ bool VocalTransformerAudioProcessor::isBusesLayoutSupported (const BusesLayout&
 
 void VocalTransformerAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
     // Clear any output channels that don't contain input data
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
-
-    // Get parameters
-    auto* characterParam = parameters.getRawParameterValue(CHARACTER_ID);
-    auto* characterStrengthParam = parameters.getRawParameterValue(CHARACTER_STRENGTH_ID);
-    auto* pitchShiftParam = parameters.getRawParameterValue(PITCH_SHIFT_ID);
-    auto* formantShiftParam = parameters.getRawParameterValue(FORMANT_SHIFT_ID);
-    auto* voiceCountParam = parameters.getRawParameterValue(VOICE_COUNT_ID);
-    auto* detuneParam = parameters.getRawParameterValue(DETUNE_ID);
-    auto* reverbParam = parameters.getRawParameterValue(REVERB_ID);
-    auto* distortionParam = parameters.getRawParameterValue(DISTORTION_ID);
-    auto* lowCutParam = parameters.getRawParameterValue(LOW_CUT_ID);
-    auto* toneParam = parameters.getRawParameterValue(TONE_ID);
-    
-    distortionValue = distortionParam->load();
-    lowCutValue = lowCutParam->load();
-    toneValue = toneParam->load();
     
-    // Apply character preset if needed
-    int currentCharacter = (int)characterParam->load();
-    float strength = characterStrengthParam->load();
-    
-    if (currentCharacter > 0 && strength > 0.0f) {
-        applyCharacterPreset(currentCharacter, strength);
-    }
+    inputTap.push(buffer);
     
-    // Convert pitch shift from semitones to ratio
-    float pitchShiftSemitones = pitchShiftParam->load();
-    float pitchRatio = std::pow(2.0f, pitchShiftSemitones / 12.0f);
+    // A new latency profile resizes buffers and the convolution reverb's loader
+    // starts a thread, both of which are left to the message thread
+    if (engine.isPrepareNeeded() || engine.isLoaderNeeded())
+        triggerAsyncUpdate();
     
-    // Apply processing stages
+    engine.process(buffer, totalNumInputChannels);
     
-    // 1. Input gain
-    juce::dsp::AudioBlock<float> block(buffer);
-    juce::dsp::ProcessContextReplacing<float> context(block);
-    inputGain.process(context);
+    // Switching the quality mode or oversampling changes the latency. Reporting it
+    // calls into the host, so that's left to the message thread too.
+    if (engine.getLatencySamples() != getLatencySamples())
+        triggerAsyncUpdate();
     
-    // 2. Apply low cut filter
-    applyLowCut(buffer, lowCutValue);
-    
-    // 3. Pitch shifting
-    pitchShifter.setPitchRatio(pitchRatio);
-    pitchShifter.processBlock(buffer);
-    
-    // 4. Formant shifting
-    formantShifter.setFormantShift(formantShiftParam->load());
-    formantShifter.processBlock(buffer);
-    
-    // 5. Voice multiplication
-    voiceMultiplier.setVoiceCount((int)voiceCountParam->load());
-    voiceMultiplier.setDetune(detuneParam->load());
-    voiceMultiplier.processBlock(buffer);
-    
-    // 6. Apply tone control
-    applyToneControl(buffer, toneValue);
-    
-    // 7. Apply distortion effect
-    applyDistortion(buffer, distortionValue);
-    
-    // 8. Apply reverb
-    juce::Reverb::Parameters reverbParams;
-    reverbParams.roomSize = 0.5f;
-    reverbParams.damping = 0.5f;
-    reverbParams.wetLevel = reverbParam->load();
-    reverbParams.dryLevel = 1.0f - (reverbParam->load() * 0.5f); // Ensure dry signal remains audible
-    reverbParams.width = 1.0f;
-    reverb.setParameters(reverbParams);
-    
-    if (buffer.getNumChannels() == 1) {
-        reverb.processMono(buffer.getWritePointer(0), buffer.getNumSamples());
-    } else {
-        reverb.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), buffer.getNumSamples());
-    }
-    
-    // 9. Output gain
-    outputGain.process(context);
-}
-
-void VocalTransformerAudioProcessor::applyDistortion(juce::AudioBuffer<float>& buffer, float amount)
-{
-    // Skip processing if distortion is set to zero
-    if (amount <= 0.001f)
-        return;
-        
-    // Simple distortion algorithm
-    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
-    {
-        float* channelData = buffer.getWritePointer(channel);
-        
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
-        {
-            // Soft clipping distortion - more amount means more distortion
-            float input = channelData[sample];
-            float distorted = std::tanh(input * (1.0f + 20.0f * amount));
-            
-            // Mix between clean and distorted signal
-            channelData[sample] = input * (1.0f - amount) + distorted * amount;
-        }
-    }
-}
-
-void VocalTransformerAudioProcessor::applyLowCut(juce::AudioBuffer<float>& buffer, float frequency)
-{
-    // Skip processing if low cut is at minimum
-    if (frequency <= 21.0f)
-        return;
-        
-    // Very simple high-pass filter (low cut)
-    // This is a very basic implementation - a real plugin would use a proper filter
-    static float lastSamples[2] = {0.0f, 0.0f}; // For left and right channels
-    
-    // Convert frequency to a coefficient (very simplified)
-    float alpha = 0.01f + 0.5f * (frequency / 1000.0f);
-    if (alpha > 0.99f) alpha = 0.99f;
-    
-    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
-    {
-        float* channelData = buffer.getWritePointer(channel);
-        
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
-        {
-            // Simple high-pass filter
-            float filtered = alpha * (lastSamples[channel] + channelData[sample] - lastSamples[channel]);
-            lastSamples[channel] = channelData[sample];
-            channelData[sample] = filtered;
-        }
-    }
-}
-
-void VocalTransformerAudioProcessor::applyToneControl(juce::AudioBuffer<float>& buffer, float toneAmount)
-{
-    // Skip processing if tone is in the middle position
-    if (toneAmount > 0.49f && toneAmount < 0.51f)
-        return;
-        
-    // Simple tone control - boost high frequencies or low frequencies
-    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
-    {
-        float* channelData = buffer.getWritePointer(channel);
-        static float lastSample = 0.0f;
-        
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
-        {
-            // Simple 1-pole filter for tone control
-            if (toneAmount > 0.5f) {
-                // Boost highs (reduce lows)
-                float highAmount = (toneAmount - 0.5f) * 2.0f; // 0 to 1
-                float highPass = 0.8f * (channelData[sample] - lastSample);
-                channelData[sample] = channelData[sample] * (1.0f - highAmount) + highPass * highAmount;
-            }
-            else {
-                // Boost lows
-                float lowAmount = (0.5f - toneAmount) * 2.0f; // 0 to 1
-                float lowPass = 0.2f * channelData[sample] + 0.8f * lastSample;
-                channelData[sample] = channelData[sample] * (1.0f - lowAmount) + lowPass * lowAmount;
-            }
-            
-            lastSample = channelData[sample];
-        }
-    }
+    outputTap.push(buffer);
 }
 
 //==============================================================================
@@ -459,6 +331,26 @@ void VocalTransformerAudioProcessor::setStateInformation (const void* data, int
     if (xmlState.get() != nullptr)
         if (xmlState->hasTagName(parameters.state.getType()))
             parameters.replaceState(juce::ValueTree::fromXml(*xmlState));
+    
+    // The impulse response file is stored as a path next to the parameters
+    const juce::String impulseResponsePath = parameters.state.getProperty(IMPULSE_RESPONSE_FILE_ID).toString();
+    engine.loadImpulseResponse(impulseResponsePath.isNotEmpty() ? juce::File(impulseResponsePath) : juce::File());
+}
+
+void VocalTransformerAudioProcessor::loadImpulseResponse(const juce::File& file)
+{
+    parameters.state.setProperty(IMPULSE_RESPONSE_FILE_ID, file.getFullPathName(), nullptr);
+    engine.loadImpulseResponse(file);
+}
+
+juce::File VocalTransformerAudioProcessor::getImpulseResponseFile() const
+{
+    return engine.getImpulseResponseFile();
+}
+
+bool VocalTransformerAudioProcessor::waitUntilReady(int timeoutMilliseconds)
+{
+    return engine.waitUntilReady(timeoutMilliseconds);
 }
 
 //==============================================================================
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StftEngine.h"
+
+// Phase-vocoder pitch shifter with peak-locked phases.
+// Each bin's true frequency is estimated from its phase advance since the last hop.
+// Every spectral peak then moves, together with the bins around it, by
+// (ratio - 1) times its frequency. Each moved region is rotated by one phase, so
+// the peak keeps advancing at the scaled frequency and the region's shape, and
+// therefore its amplitude, stays intact. Shifting the whole spectrum also moves the
+// formants; SpectralFormantShifter compensates for that when it runs afterwards.
+class SpectralPitchShifter : public StftEngine::Stage {
+public:
+    void setPitchRatio(float newRatio) {
+        pitchRatio = juce::jlimit(0.5f, 2.0f, newRatio);
+    }
+
+    void prepare(double, int fftSize, int hopSize, int numChannels) override {
+        numBins = fftSize / 2 + 1;
+        expectedAdvance = juce::MathConstants<float>::twoPi * (float) hopSize / (float) fftSize;
+
+        lastPhase.assign((size_t) numChannels, std::vector<float>((size_t) numBins, 0.0f));
+        synthesisPhase.assign((size_t) numChannels, std::vector<float>((size_t) numBins, 0.0f));
+        nextSynthesisPhase.assign((size_t) numBins, 0.0f);
+        analysisBins.assign((size_t) numBins, {});
+        magnitude.assign((size_t) numBins, 0.0f);
+        phase.assign((size_t) numBins, 0.0f);
+        advance.assign((size_t) numBins, 0.0f);
+        peaks.assign((size_t) numBins, 0);
+    }
+
+    void reset() override {
+        for (auto& phases : lastPhase)
+            std::fill(phases.begin(), phases.end(), 0.0f);
+        for (auto& phases : synthesisPhase)
+            std::fill(phases.begin(), phases.end(), 0.0f);
+    }
+
+    void processFrame(int channel, std::complex<float>* bins, int frameBins) override {
+        auto& previous = lastPhase[(size_t) channel];
+        auto& synthesis = synthesisPhase[(size_t) channel];
+        const int count = juce::jmin(frameBins, numBins);
+
+        // Unshifted frames pass through, but keep the phase state continuous
+        if (std::abs(pitchRatio - 1.0f) < 1.0e-4f) {
+            for (int k = 0; k < count; ++k)
+                previous[(size_t) k] = synthesis[(size_t) k] = std::arg(bins[k]);
+            return;
+        }
+
+        const float twoPi = juce::MathConstants<float>::twoPi;
+        float peakThreshold = 0.0f;
+
+        for (int k = 0; k < count; ++k) {
+            const float binPhase = std::arg(bins[k]);
+            float deviation = binPhase - previous[(size_t) k] - (float) k * expectedAdvance;
+            deviation -= twoPi * std::round(deviation / twoPi);
+
+            analysisBins[(size_t) k] = bins[k];
+            magnitude[(size_t) k] = std::abs(bins[k]);
+            phase[(size_t) k] = binPhase;
+            advance[(size_t) k] = (float) k * expectedAdvance + deviation;
+            previous[(size_t) k] = binPhase;
+            peakThreshold = juce::jmax(peakThreshold, magnitude[(size_t) k]);
+        }
+
+        peakThreshold *= 1.0e-3f; // -60 dB below the loudest bin
+
+        int numPeaks = 0;
+        for (int k = 2; k < count - 2; ++k) {
+            const float m = magnitude[(size_t) k];
+            if (m > peakThreshold
+                && m >= magnitude[(size_t) (k - 1)] && m >= magnitude[(size_t) (k - 2)]
+                && m > magnitude[(size_t) (k + 1)] && m > magnitude[(size_t) (k + 2)])
+                peaks[(size_t) numPeaks++] = k;
+        }
+
+        std::fill(bins, bins + count, std::complex<float>());
+        std::copy(synthesis.begin(), synthesis.end(), nextSynthesisPhase.begin());
+
+        for (int i = 0; i < numPeaks; ++i) {
+            const int peak = peaks[(size_t) i];
+            const int regionStart = i == 0 ? 0 : (peaks[(size_t) (i - 1)] + peak + 1) / 2;
+            const int regionEnd = i == numPeaks - 1 ? count : (peak + peaks[(size_t) (i + 1)] + 1) / 2;
+
+            // advance / expectedAdvance is the peak's true frequency in bins
+            const int shift = (int) std::round(advance[(size_t) peak] / expectedAdvance * (pitchRatio - 1.0f));
+            const int target = peak + shift;
+            if (target < 0 || target >= count)
+                continue;
+
+            float peakPhase = synthesis[(size_t) target] + advance[(size_t) peak] * pitchRatio;
+            peakPhase -= twoPi * std::floor(peakPhase / twoPi);
+            const float rotation = peakPhase - phase[(size_t) peak];
+            const auto rotor = std::polar(1.0f, rotation);
+
+            const int first = juce::jmax(regionStart, -shift);
+            const int last = juce::jmin(regionEnd, count - shift);
+            for (int j = first; j < last; ++j) {
+                bins[j + shift] += analysisBins[(size_t) j] * rotor;
+                nextSynthesisPhase[(size_t) (j + shift)] = phase[(size_t) j] + rotation;
+            }
+        }
+
+        std::copy(nextSynthesisPhase.begin(), nextSynthesisPhase.end(), synthesis.begin());
+    }
+
+private:
+    float pitchRatio = 1.0f;
+    int numBins = 0;
+    float expectedAdvance = 0.0f;
+
+    std::vector<std::vector<float>> lastPhase;
+    std::vector<std::vector<float>> synthesisPhase;
+    std::vector<float> nextSynthesisPhase;
+    std::vector<std::complex<float>> analysisBins;
+    std::vector<float> magnitude;
+    std::vector<float> phase;
+    std::vector<float> advance;
+    std::vector<int> peaks;
+};
+
+// Cepstral envelope formant shifter.
+// The log magnitude is liftered to its first 1.5 ms of quefrency to get a smooth
+// envelope, and each bin is re-weighted by the envelope read at k / warp.
+// warp = formant ratio / pitch ratio, so a pitch-shifted frame gets its original
+// formants back, moved by the formant_shift parameter.
+class SpectralFormantShifter : public StftEngine::Stage {
+public:
+    void setFormantShift(float newShift) {
+        formantRatio = std::pow(2.0f, juce::jlimit(0.0f, 1.0f, newShift) - 0.5f);
+    }
+
+    // Pitch ratio applied by earlier stages, whose formant movement is undone here
+    void setPitchRatio(float newRatio) {
+        pitchRatio = juce::jlimit(0.5f, 2.0f, newRatio);
+    }
+
+    void prepare(double sampleRate, int fftSize, int, int) override {
+        size = fftSize;
+        numBins = fftSize / 2 + 1;
+
+        int order = 0;
+        while ((1 << order) < fftSize)
+            ++order;
+
+        fft = std::make_unique<juce::dsp::FFT>(order);
+        cepstrum.assign((size_t) (2 * fftSize), 0.0f);
+        envelope.assign((size_t) numBins, 0.0f);
+
+        // Half-Hann taper on the low quefrencies avoids ringing in the envelope
+        const int lifterLength = juce::jlimit(8, numBins - 1, (int) (sampleRate * 0.0015));
+        lifter.assign((size_t) numBins, 0.0f);
+        for (int n = 0; n < lifterLength; ++n)
+            lifter[(size_t) n] = (0.5f + 0.5f * std::cos(juce::MathConstants<float>::pi * (float) n / (float) lifterLength)) / (float) fftSize;
+    }
+
+    void reset() override {}
+
+    void processFrame(int, std::complex<float>* bins, int frameBins) override {
+        const float warp = formantRatio / pitchRatio;
+        if (std::abs(warp - 1.0f) < 1.0e-3f)
+            return;
+
+        const int count = juce::jmin(frameBins, numBins);
+
+        // Real cepstrum of the (even) log magnitude
+        for (int k = 0; k < count; ++k) {
+            const float logMagnitude = std::log(std::abs(bins[k]) + 1.0e-9f);
+            cepstrum[(size_t) k] = logMagnitude;
+            if (k > 0 && k < size - k)
+                cepstrum[(size_t) (size - k)] = logMagnitude;
+        }
+
+        fft->performRealOnlyForwardTransform(cepstrum.data(), true);
+
+        // Keep the low quefrencies (real parts only, the input was even) and
+        // transform back to a smoothed log spectrum
+        for (int n = 0; n < count; ++n)
+            envelope[(size_t) n] = cepstrum[(size_t) (2 * n)] * lifter[(size_t) n];
+
+        for (int n = 0; n < count; ++n) {
+            cepstrum[(size_t) n] = envelope[(size_t) n];
+            if (n > 0 && n < size - n)
+                cepstrum[(size_t) (size - n)] = envelope[(size_t) n];
+        }
+
+        fft->performRealOnlyForwardTransform(cepstrum.data(), true);
+
+        for (int k = 0; k < count; ++k)
+            envelope[(size_t) k] = cepstrum[(size_t) (2 * k)];
+
+        const float inverseWarp = 1.0f / warp;
+        for (int k = 0; k < count; ++k) {
+            const float source = juce::jmin((float) k * inverseWarp, (float) (count - 1));
+            const int whole = juce::jmin((int) source, count - 2);
+            const float fraction = source - (float) whole;
+            const float warped = envelope[(size_t) whole] + fraction * (envelope[(size_t) (whole + 1)] - envelope[(size_t) whole]);
+
+            bins[k] *= std::exp(juce::jlimit(-4.0f, 4.0f, warped - envelope[(size_t) k]));
+        }
+    }
+
+private:
+    float formantRatio = 1.0f;
+    float pitchRatio = 1.0f;
+    int size = 0;
+    int numBins = 0;
+
+    std::unique_ptr<juce::dsp::FFT> fft;
+    std::vector<float> cepstrum;
+    std::vector<float> envelope;
+    std::vector<float> lifter;
+};
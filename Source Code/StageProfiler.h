@@ -0,0 +1,274 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Times the stages of processBlock, for finding out which one causes a dropout.
+// The audio thread is the only writer. Each stage's time per block goes into a
+// histogram of relaxed atomic counters, quarter-octave buckets from 1 ns up to
+// 4 seconds, so any other thread can poll percentiles without locks. A reset is only
+// requested from outside and carried out by the audio thread at its next block.
+// Off by default. While off, every timer costs one branch on a plain bool.
+class StageProfiler {
+public:
+    enum Stage {
+        controls = 0,       // parameters, preset blend, engine switches
+        inputStages,        // input gain, low cut
+        pitchAndFormant,    // pitch tracker, pitch and formant shifters
+        voices,
+        outputStages,       // tone, distortion, output gain
+        reverb,
+        numStages
+    };
+
+    static const char* getStageName(Stage stage) {
+        static const char* const names[] = { "Controls", "Input", "Pitch/Formant", "Voices", "Output", "Reverb" };
+        return names[(size_t) stage];
+    }
+
+    // Time per block, in microseconds
+    struct Stats {
+        double p50 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    struct Snapshot {
+        std::array<Stats, numStages> stages;
+        Stats total;                    // the whole of processBlock
+        double averageLoad = 0.0;       // time spent over the length of the audio, 1 = all of it
+        double peakLoad = 0.0;
+        juce::uint32 numBlocks = 0;
+        juce::uint32 numOverruns = 0;   // blocks that took longer than they last
+    };
+
+    StageProfiler() {
+        clear();
+    }
+
+    // Any thread
+    void setEnabled(bool shouldBeEnabled) {
+        enabled.store(shouldBeEnabled, std::memory_order_relaxed);
+    }
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Any thread, the audio thread clears everything before its next block
+    void reset() {
+        resetRequested.store(true, std::memory_order_relaxed);
+    }
+
+    // Not called while audio is running
+    void prepare(double newSampleRate) {
+        sampleRate = newSampleRate;
+        clear();
+    }
+
+    // Any thread. Counters that move while they are read can leave the figures one
+    // block out, which doesn't matter for statistics.
+    Snapshot getSnapshot() const {
+        Snapshot snapshot;
+        for (size_t stage = 0; stage < (size_t) numStages; ++stage)
+            snapshot.stages[stage] = stageTimes[stage].getStats();
+
+        snapshot.total = blockTimes.getStats();
+        snapshot.numBlocks = numBlocks.load(std::memory_order_relaxed);
+        snapshot.numOverruns = numOverruns.load(std::memory_order_relaxed);
+        snapshot.peakLoad = peakLoad.load(std::memory_order_relaxed);
+
+        const auto period = totalPeriodNs.load(std::memory_order_relaxed);
+        if (period > 0)
+            snapshot.averageLoad = (double) totalBusyNs.load(std::memory_order_relaxed) / (double) period;
+
+        return snapshot;
+    }
+
+    // Times one block, from construction to destruction. Audio thread only.
+    class ScopedBlock {
+    public:
+        ScopedBlock(StageProfiler& owner, int numSamples) : profiler(owner), blockSize(numSamples) {
+            profiler.beginBlock();
+        }
+
+        ~ScopedBlock() {
+            profiler.endBlock(blockSize);
+        }
+
+    private:
+        StageProfiler& profiler;
+        int blockSize;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedBlock)
+    };
+
+    // Adds the time from construction to stop() or destruction to a stage. A stage
+    // timed several times in a block, once per slice, adds up to one figure.
+    class ScopedTimer {
+    public:
+        ScopedTimer(StageProfiler& owner, Stage timedStage)
+            : profiler(owner.recording ? &owner : nullptr),
+              stage((size_t) timedStage),
+              start(profiler != nullptr ? juce::Time::getHighResolutionTicks() : 0) {}
+
+        ~ScopedTimer() {
+            stop();
+        }
+
+        void stop() {
+            if (profiler == nullptr)
+                return;
+
+            profiler->blockTicks[stage] += juce::Time::getHighResolutionTicks() - start;
+            profiler->stageRan[stage] = true;
+            profiler = nullptr;
+        }
+
+    private:
+        StageProfiler* profiler;
+        size_t stage;
+        juce::int64 start;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedTimer)
+    };
+
+private:
+    static constexpr int numBuckets = 128;
+
+    // Quarter octaves, exact below 4 ns
+    static int getBucket(juce::uint32 ns) {
+        if (ns < 4)
+            return (int) ns;
+
+        const int octave = juce::findHighestSetBit(ns);
+        return octave * 4 + (int) ((ns >> (octave - 2)) & 3);
+    }
+
+    // Top of a bucket's range, so percentiles err on the slow side
+    static double getBucketLimit(int bucket) {
+        if (bucket < 8)
+            return bucket + 1.0;
+
+        return (double) (4 + bucket % 4 + 1) * std::ldexp(1.0, bucket / 4 - 2);
+    }
+
+    struct Histogram {
+        std::array<std::atomic<juce::uint32>, numBuckets> counts;
+        std::atomic<juce::uint32> maximum { 0 };
+
+        void clear() {
+            for (auto& count : counts)
+                count.store(0, std::memory_order_relaxed);
+            maximum.store(0, std::memory_order_relaxed);
+        }
+
+        // A single writer, so no read-modify-write is needed
+        void add(juce::uint32 ns) {
+            auto& count = counts[(size_t) getBucket(ns)];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            if (ns > maximum.load(std::memory_order_relaxed))
+                maximum.store(ns, std::memory_order_relaxed);
+        }
+
+        Stats getStats() const {
+            std::array<juce::uint32, numBuckets> copy;
+            juce::uint64 total = 0;
+            for (size_t bucket = 0; bucket < copy.size(); ++bucket)
+                total += (copy[bucket] = counts[bucket].load(std::memory_order_relaxed));
+
+            Stats stats;
+            if (total == 0)
+                return stats;
+
+            auto percentile = [&](double fraction) {
+                const auto target = (juce::uint64) std::ceil(fraction * (double) total);
+                juce::uint64 sum = 0;
+                for (int bucket = 0; bucket < numBuckets; ++bucket)
+                    if ((sum += copy[(size_t) bucket]) >= target)
+                        return getBucketLimit(bucket) * 1.0e-3;
+                return getBucketLimit(numBuckets - 1) * 1.0e-3;
+            };
+
+            stats.max = maximum.load(std::memory_order_relaxed) * 1.0e-3;
+            stats.p50 = juce::jmin(percentile(0.5), stats.max);
+            stats.p99 = juce::jmin(percentile(0.99), stats.max);
+            return stats;
+        }
+    };
+
+    void clear() {
+        for (auto& histogram : stageTimes)
+            histogram.clear();
+
+        blockTimes.clear();
+        numBlocks.store(0, std::memory_order_relaxed);
+        numOverruns.store(0, std::memory_order_relaxed);
+        totalBusyNs.store(0, std::memory_order_relaxed);
+        totalPeriodNs.store(0, std::memory_order_relaxed);
+        peakLoad.store(0.0f, std::memory_order_relaxed);
+        resetRequested.store(false, std::memory_order_relaxed);
+    }
+
+    void beginBlock() {
+        recording = enabled.load(std::memory_order_relaxed);
+        if (! recording)
+            return;
+
+        if (resetRequested.load(std::memory_order_relaxed))
+            clear();
+
+        blockTicks.fill(0);
+        stageRan.fill(false);
+        blockStart = juce::Time::getHighResolutionTicks();
+    }
+
+    void endBlock(int numSamples) {
+        if (! recording)
+            return;
+
+        const double nsPerTick = 1.0e9 / (double) juce::Time::getHighResolutionTicksPerSecond();
+        auto toNs = [nsPerTick](juce::int64 ticks) {
+            return (juce::uint32) juce::jlimit(0.0, 4.0e9, (double) ticks * nsPerTick);
+        };
+
+        for (size_t stage = 0; stage < (size_t) numStages; ++stage)
+            if (stageRan[stage])
+                stageTimes[stage].add(toNs(blockTicks[stage]));
+
+        const juce::uint32 busy = toNs(juce::Time::getHighResolutionTicks() - blockStart);
+        const auto period = (juce::uint64) (numSamples * 1.0e9 / sampleRate);
+        blockTimes.add(busy);
+
+        // Single writer, as in Histogram::add()
+        numBlocks.store(numBlocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        totalBusyNs.store(totalBusyNs.load(std::memory_order_relaxed) + busy, std::memory_order_relaxed);
+        totalPeriodNs.store(totalPeriodNs.load(std::memory_order_relaxed) + period, std::memory_order_relaxed);
+
+        if (busy > period)
+            numOverruns.store(numOverruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        const float load = period > 0 ? (float) ((double) busy / (double) period) : 0.0f;
+        if (load > peakLoad.load(std::memory_order_relaxed))
+            peakLoad.store(load, std::memory_order_relaxed);
+    }
+
+    double sampleRate = 44100.0;
+
+    std::atomic<bool> enabled { false };
+    std::atomic<bool> resetRequested { false };
+
+    std::array<Histogram, numStages> stageTimes;
+    Histogram blockTimes;
+    std::atomic<juce::uint32> numBlocks { 0 };
+    std::atomic<juce::uint32> numOverruns { 0 };
+    std::atomic<juce::uint64> totalBusyNs { 0 };
+    std::atomic<juce::uint64> totalPeriodNs { 0 };
+    std::atomic<float> peakLoad { 0.0f };
+
+    // Audio thread only
+    bool recording = false;
+    juce::int64 blockStart = 0;
+    std::array<juce::int64, numStages> blockTicks {};
+    std::array<bool, numStages> stageRan {};
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Shared short-time Fourier analysis/synthesis engine.
+// The block is transformed once per hop per channel. Every registered stage then
+// edits the same spectrum in place, and the result is overlap-added back. Hann
+// analysis and synthesis windows are used at 4x overlap unless set otherwise.
+// Every buffer, including the stages' own scratch, is sized in prepare(), so the
+// hop loop never allocates.
+// The output is delayed by exactly one FFT length.
+class StftEngine {
+public:
+    // A spectral processing step that runs on the engine's frames
+    class Stage {
+    public:
+        virtual ~Stage() = default;
+        virtual void prepare(double sampleRate, int fftSize, int hopSize, int numChannels) = 0;
+        virtual void reset() = 0;
+        // bins holds fftSize / 2 + 1 non-negative frequency bins of one channel
+        virtual void processFrame(int channel, std::complex<float>* bins, int numBins) = 0;
+    };
+
+    // Stages run in the order they were added; call before prepare()
+    void addStage(Stage* stage) {
+        jassert(numStages < (int) stages.size());
+        stages[(size_t) numStages++] = stage;
+    }
+
+    // FFT order relative to the default for the sample rate (-1 halves the window and
+    // the latency, +1 doubles them) and frames per window. Call before prepare().
+    void setResolution(int newOrderOffset, int newOverlap) {
+        orderOffset = juce::jlimit(-2, 2, newOrderOffset);
+        overlap = juce::jlimit(2, 16, juce::nextPowerOfTwo(newOverlap));
+    }
+
+    void prepare(const juce::dsp::ProcessSpec& spec) {
+        numChannels = (int) spec.numChannels;
+
+        // About 43 ms of analysis at 44.1/48 kHz by default, scaled with the rate
+        int order = 11 + orderOffset;
+        if (spec.sampleRate < 30000.0) --order;
+        if (spec.sampleRate > 60000.0) ++order;
+        if (spec.sampleRate > 120000.0) ++order;
+
+        fft = std::make_unique<juce::dsp::FFT>(order);
+        fftSize = fft->getSize();
+        hopSize = fftSize / overlap;
+        fftMask = fftSize - 1;
+
+        window.resize((size_t) fftSize);
+        for (int n = 0; n < fftSize; ++n)
+            window[(size_t) n] = 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * (float) n / (float) fftSize);
+
+        // Hann analysis x Hann synthesis sums to 3/8 of the overlap
+        float windowPowerSum = 0.0f;
+        for (int n = 0; n < fftSize; n += hopSize)
+            windowPowerSum += window[(size_t) n] * window[(size_t) n];
+        outputScale = 1.0f / windowPowerSum;
+
+        inputRing.assign((size_t) numChannels, std::vector<float>((size_t) fftSize, 0.0f));
+        outputRing.assign((size_t) numChannels, std::vector<float>((size_t) (2 * fftSize), 0.0f));
+        frame.assign((size_t) (2 * fftSize), 0.0f);
+
+        for (int i = 0; i < numStages; ++i)
+            stages[(size_t) i]->prepare(spec.sampleRate, fftSize, hopSize, numChannels);
+
+        reset();
+    }
+
+    void reset() {
+        for (auto& ring : inputRing)
+            std::fill(ring.begin(), ring.end(), 0.0f);
+        for (auto& ring : outputRing)
+            std::fill(ring.begin(), ring.end(), 0.0f);
+
+        writePos = 0;
+        outputPos = 0;
+        samplesUntilHop = hopSize;
+
+        for (int i = 0; i < numStages; ++i)
+            stages[(size_t) i]->reset();
+    }
+
+    int getLatencyInSamples() const {
+        return fftSize;
+    }
+
+    // Latency plus the last frame still being overlap-added
+    int getTailInSamples() const {
+        return 2 * fftSize;
+    }
+
+    int getFftSize() const {
+        return fftSize;
+    }
+
+    void processBlock(juce::AudioBuffer<float>& buffer) {
+        const int numSamples = buffer.getNumSamples();
+        const int channels = juce::jmin(buffer.getNumChannels(), numChannels);
+        const int outputMask = 2 * fftSize - 1;
+
+        int start = 0;
+        while (start < numSamples) {
+            const int segment = juce::jmin(numSamples - start, samplesUntilHop);
+
+            for (int channel = 0; channel < channels; ++channel) {
+                float* data = buffer.getWritePointer(channel, start);
+                float* input = inputRing[(size_t) channel].data();
+                float* output = outputRing[(size_t) channel].data();
+
+                for (int i = 0; i < segment; ++i) {
+                    input[(writePos + i) & fftMask] = data[i];
+
+                    // Read one FFT length behind the write head, then clear for reuse
+                    const int readIndex = (outputPos + i) & outputMask;
+                    data[i] = output[readIndex];
+                    output[readIndex] = 0.0f;
+                }
+            }
+
+            writePos = (writePos + segment) & fftMask;
+            outputPos = (outputPos + segment) & outputMask;
+            start += segment;
+            samplesUntilHop -= segment;
+
+            if (samplesUntilHop == 0) {
+                samplesUntilHop = hopSize;
+                for (int channel = 0; channel < channels; ++channel)
+                    processFrame(channel);
+            }
+        }
+    }
+
+private:
+    void processFrame(int channel) {
+        const float* input = inputRing[(size_t) channel].data();
+        float* output = outputRing[(size_t) channel].data();
+        const int outputMask = 2 * fftSize - 1;
+        const int numBins = fftSize / 2 + 1;
+
+        // Oldest sample of the frame sits at writePos once the ring is full
+        for (int n = 0; n < fftSize; ++n)
+            frame[(size_t) n] = window[(size_t) n] * input[(writePos + n) & fftMask];
+
+        fft->performRealOnlyForwardTransform(frame.data(), true);
+
+        auto* bins = reinterpret_cast<std::complex<float>*>(frame.data());
+        for (int i = 0; i < numStages; ++i)
+            stages[(size_t) i]->processFrame(channel, bins, numBins);
+
+        // Rebuild the negative frequencies so the inverse sees a Hermitian spectrum
+        for (int k = numBins; k < fftSize; ++k)
+            bins[k] = std::conj(bins[fftSize - k]);
+
+        fft->performRealOnlyInverseTransform(frame.data());
+
+        // The frame covers the fftSize samples that are now next in line to be read
+        for (int n = 0; n < fftSize; ++n)
+            output[(outputPos + n) & outputMask] += outputScale * window[(size_t) n] * frame[(size_t) n];
+    }
+
+    std::array<Stage*, 4> stages {};
+    int numStages = 0;
+
+    std::unique_ptr<juce::dsp::FFT> fft;
+    int orderOffset = 0;
+    int overlap = 4;
+    int fftSize = 2048;
+    int hopSize = 512;
+    int fftMask = 2047;
+    int numChannels = 0;
+
+    std::vector<float> window;
+    std::vector<std::vector<float>> inputRing;
+    std::vector<std::vector<float>> outputRing;
+    std::vector<float> frame;
+    float outputScale = 1.0f;
+
+    int writePos = 0;
+    int outputPos = 0;
+    int samplesUntilHop = 0;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "VocalTransformerEngine.h"
+
+// Streaming front end for a VocalTransformerEngine: takes chunks of any length,
+// from one sample to many thousands, and runs the chain in blocks of one fixed size.
+// Every block costs the same, and the block plus the stages' per-block state stay
+// in L1 however the caller slices the audio.
+//
+// Input collects in a FIFO until a whole block is there; processed blocks go to an
+// output FIFO that each call reads back the same number of samples from. The output
+// FIFO starts with blockSize - 1 samples of silence, which is the least that
+// guarantees a full chunk can always be read. That is the latency this adds on top
+// of the engine's own. Both FIFOs are single-producer, single-consumer and
+// lock-free, and everything is allocated in prepare().
+class StreamingEngine {
+public:
+    static constexpr int defaultBlockSize = 128;
+
+    explicit StreamingEngine(VocalTransformerEngine& engineToDrive) : engine(engineToDrive) {}
+
+    // Prepares the engine for the block size too. Not called while audio is running.
+    void prepare(double sampleRate, int newNumChannels, int newBlockSize = defaultBlockSize) {
+        blockSize = juce::jmax(1, newBlockSize);
+        numChannels = juce::jmax(1, newNumChannels);
+
+        engine.prepare(sampleRate, blockSize, numChannels);
+        block.setSize(numChannels, blockSize);
+
+        // An AbstractFifo holds one less than its size
+        inputFifo.setTotalSize(blockSize + 1);
+        outputFifo.setTotalSize(2 * blockSize);
+
+        for (auto* storage : { &inputStorage, &outputStorage })
+            storage->setSize(numChannels, 2 * blockSize);
+
+        reset();
+    }
+
+    // Drops anything buffered and starts again from silence
+    void reset() {
+        inputFifo.reset();
+        outputFifo.reset();
+        block.clear();
+        inputStorage.clear();
+        outputStorage.clear();
+
+        int start1, size1, start2, size2;
+        outputFifo.prepareToWrite(getAddedLatencySamples(), start1, size1, start2, size2);
+        outputFifo.finishedWrite(size1 + size2);
+    }
+
+    // Any number of samples. Input and output may be the same channels, and only the
+    // prepared number of channels is used.
+    void process(const float* const* input, float* const* output, int numSamples) {
+        for (int done = 0; done < numSamples;) {
+            const int numToPush = juce::jmin(numSamples - done, blockSize - inputFifo.getNumReady());
+
+            write(inputFifo, inputStorage, input, done, numToPush);
+
+            if (inputFifo.getNumReady() == blockSize) {
+                read(inputFifo, inputStorage, block.getArrayOfWritePointers(), 0, blockSize);
+                engine.process(block.getArrayOfWritePointers(), numChannels, blockSize);
+                write(outputFifo, outputStorage, block.getArrayOfReadPointers(), 0, blockSize);
+            }
+
+            read(outputFifo, outputStorage, output, done, numToPush);
+            done += numToPush;
+        }
+    }
+
+    int getBlockSize() const { return blockSize; }
+
+    // On top of the engine's own
+    int getAddedLatencySamples() const { return blockSize - 1; }
+
+    int getLatencySamples() const { return engine.getLatencySamples() + getAddedLatencySamples(); }
+
+private:
+    static void write(juce::AbstractFifo& fifo, juce::AudioBuffer<float>& storage,
+                      const float* const* source, int offset, int numSamples) {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+        for (int c = 0; c < storage.getNumChannels(); ++c) {
+            const float* data = source[c] + offset;
+            float* destination = storage.getWritePointer(c);
+            std::copy(data, data + size1, destination + start1);
+            std::copy(data + size1, data + size1 + size2, destination + start2);
+        }
+
+        fifo.finishedWrite(size1 + size2);
+    }
+
+    static void read(juce::AbstractFifo& fifo, const juce::AudioBuffer<float>& storage,
+                     float* const* destination, int offset, int numSamples) {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(numSamples, start1, size1, start2, size2);
+
+        for (int c = 0; c < storage.getNumChannels(); ++c) {
+            const float* data = storage.getReadPointer(c);
+            std::copy(data + start1, data + start1 + size1, destination[c] + offset);
+            std::copy(data + start2, data + start2 + size2, destination[c] + offset + size1);
+        }
+
+        fifo.finishedRead(size1 + size2);
+    }
+
+    VocalTransformerEngine& engine;
+
+    int blockSize = defaultBlockSize;
+    int numChannels = 0;
+
+    juce::AbstractFifo inputFifo { defaultBlockSize + 1 };
+    juce::AbstractFifo outputFifo { 2 * defaultBlockSize };
+    juce::AudioBuffer<float> inputStorage;
+    juce::AudioBuffer<float> outputStorage;
+    juce::AudioBuffer<float> block;     // the one the chain runs on
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamingEngine)
+};
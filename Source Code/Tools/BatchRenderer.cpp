@@ -0,0 +1,386 @@
+// Renders audio files through the plugin offline, without a host or an editor.
+// Built by the BatchRenderer target in CMakeLists.txt, with the plugin's sources and
+// juce_audio_formats (WAV, AIFF and FLAC).
+//
+//     BatchRenderer [options] <file or folder>...
+//
+//     --state <file>        state saved by getStateInformation(), or preset XML
+//     --param <id>=<value>  sets a parameter to a plain value, after the state
+//     --output <folder>     where rendered files go (default: next to each input)
+//     --suffix <text>       added to output file names (default: _transformed)
+//     --threads <n>         worker threads (default: one per core)
+//     --block <n>           samples per processBlock() call (default: 8192)
+//     --no-tail             stop at the input's length instead of letting the tail ring out
+//
+// Each worker thread owns one processor and takes files off a shared queue. WAV and
+// AIFF inputs are memory-mapped, anything else streams from disk. Output has the
+// input's format at 24 bits and goes through buffered writers on a shared background
+// thread. The plugin's latency is trimmed off the start, so output lines up with input.
+// For the best quality add "--param latency_profile=2" (Offline).
+
+#include <JuceHeader.h>
+#include "../PluginProcessor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    constexpr int defaultBlockSize = 8192;
+    constexpr int writerBufferSize = 1 << 17;
+    constexpr int loadTimeoutMs = 30000;
+
+    struct Options
+    {
+        juce::File stateFile;
+        std::vector<std::pair<juce::String, float>> parameterValues;
+        juce::File outputFolder;
+        juce::String suffix = "_transformed";
+        int numThreads = 0;
+        int blockSize = defaultBlockSize;
+        bool renderTail = true;
+        juce::Array<juce::File> inputs;
+    };
+
+    struct Result
+    {
+        bool succeeded = false;
+        double audioSeconds = 0.0;
+        double renderSeconds = 0.0;
+    };
+
+    std::mutex printLock;
+
+    template <typename... Args>
+    void print(const char* format, Args... args)
+    {
+        const std::lock_guard<std::mutex> lock(printLock);
+        std::printf(format, args...);
+        std::fflush(stdout);
+    }
+
+    void printUsage()
+    {
+        std::printf("Usage: BatchRenderer [--state file] [--param id=value]... [--output folder] [--suffix text]\n"
+                    "                     [--threads n] [--block n] [--no-tail] <file or folder>...\n");
+    }
+
+    bool parseArguments(int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const juce::String argument(argv[i]);
+            const bool hasValue = i + 1 < argc;
+
+            if (argument == "--state" && hasValue)
+                options.stateFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+            else if (argument == "--param" && hasValue)
+            {
+                const juce::String assignment(argv[++i]);
+                if (! assignment.containsChar('='))
+                    return false;
+                options.parameterValues.emplace_back(assignment.upToFirstOccurrenceOf("=", false, false),
+                                                     assignment.fromFirstOccurrenceOf("=", false, false).getFloatValue());
+            }
+            else if (argument == "--output" && hasValue)
+                options.outputFolder = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+            else if (argument == "--suffix" && hasValue)
+                options.suffix = argv[++i];
+            else if (argument == "--threads" && hasValue)
+                options.numThreads = juce::String(argv[++i]).getIntValue();
+            else if (argument == "--block" && hasValue)
+                options.blockSize = juce::jlimit(32, 1 << 16, juce::String(argv[++i]).getIntValue());
+            else if (argument == "--no-tail")
+                options.renderTail = false;
+            else if (argument.startsWith("--"))
+                return false;
+            else
+                options.inputs.add(juce::File::getCurrentWorkingDirectory().getChildFile(argument));
+        }
+
+        return ! options.inputs.isEmpty();
+    }
+
+    // Folders are searched for audio files, skipping earlier renders
+    juce::Array<juce::File> findInputFiles(const Options& options)
+    {
+        juce::Array<juce::File> files;
+
+        for (const auto& input : options.inputs)
+        {
+            if (input.isDirectory())
+            {
+                auto found = input.findChildFiles(juce::File::findFiles, true, "*.wav;*.aif;*.aiff;*.flac");
+                found.sort();
+
+                for (const auto& file : found)
+                    if (! file.getFileNameWithoutExtension().endsWith(options.suffix))
+                        files.add(file);
+            }
+            else if (input.existsAsFile())
+                files.add(input);
+            else
+                print("%s: not found\n", input.getFullPathName().toRawUTF8());
+        }
+
+        return files;
+    }
+
+    juce::File getOutputFile(const juce::File& input, const Options& options)
+    {
+        const auto folder = options.outputFolder != juce::File() ? options.outputFolder : input.getParentDirectory();
+        return folder.getChildFile(input.getFileNameWithoutExtension() + options.suffix + input.getFileExtension());
+    }
+
+    // Every worker gets the same settings
+    std::unique_ptr<VocalTransformerAudioProcessor> createProcessor(const Options& options)
+    {
+        auto processor = std::make_unique<VocalTransformerAudioProcessor>();
+        processor->setNonRealtime(true);
+
+        if (options.stateFile != juce::File())
+        {
+            juce::MemoryBlock state;
+            if (! options.stateFile.loadFileAsData(state))
+            {
+                print("%s: can't read state\n", options.stateFile.getFullPathName().toRawUTF8());
+                return nullptr;
+            }
+
+            // Preset XML is wrapped up the way getStateInformation() stores it
+            if (auto xml = juce::parseXML(options.stateFile))
+            {
+                state.reset();
+                juce::AudioProcessor::copyXmlToBinary(*xml, state);
+            }
+
+            processor->setStateInformation(state.getData(), (int)state.getSize());
+        }
+
+        for (const auto& [id, value] : options.parameterValues)
+        {
+            auto* parameter = processor->parameters.getParameter(id);
+            if (parameter == nullptr)
+            {
+                print("Unknown parameter: %s\n", id.toRawUTF8());
+                return nullptr;
+            }
+
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        }
+
+        return processor;
+    }
+
+    std::unique_ptr<juce::AudioFormatReader> createReader(juce::AudioFormatManager& formats, const juce::File& file)
+    {
+        if (auto* format = formats.findFormatForFileExtension(file.getFileExtension()))
+        {
+            std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+            if (mapped != nullptr && mapped->mapEntireFile())
+                return mapped;
+        }
+
+        // FLAC and other compressed formats stream from disk
+        return std::unique_ptr<juce::AudioFormatReader>(formats.createReaderFor(file));
+    }
+
+    std::unique_ptr<juce::AudioFormatWriter> createWriter(juce::AudioFormatManager& formats, const juce::File& file,
+                                                          double sampleRate, int numChannels)
+    {
+        auto* format = formats.findFormatForFileExtension(file.getFileExtension());
+        if (format == nullptr || ! file.getParentDirectory().createDirectory())
+            return nullptr;
+
+        file.deleteFile();
+        std::unique_ptr<juce::FileOutputStream> stream(file.createOutputStream());
+        if (stream == nullptr)
+            return nullptr;
+
+        const int bitDepth = format->getPossibleBitDepths().contains(24) ? 24 : format->getPossibleBitDepths().getLast();
+        std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(), sampleRate, (unsigned int)numChannels,
+                                                                                 bitDepth, {}, 0));
+        if (writer != nullptr)
+            stream.release();   // owned by the writer now
+
+        return writer;
+    }
+
+    Result renderFile(VocalTransformerAudioProcessor& processor, juce::AudioFormatManager& formats,
+                      juce::TimeSliceThread& writerThread, const juce::File& input, const Options& options)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const juce::String name = input.getFileName();
+
+        auto reader = createReader(formats, input);
+        if (reader == nullptr)
+        {
+            print("%s: can't read\n", name.toRawUTF8());
+            return {};
+        }
+
+        const int numChannels = (int)reader->numChannels;
+        const double sampleRate = reader->sampleRate;
+        const int blockSize = options.blockSize;
+
+        if (numChannels < 1 || numChannels > 2)
+        {
+            print("%s: only mono and stereo files are supported\n", name.toRawUTF8());
+            return {};
+        }
+
+        // Prepared again for every file, which also clears what the last one left behind
+        processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        if (! processor.waitUntilReady(loadTimeoutMs))
+            print("%s: impulse response still loading, rendering without it\n", name.toRawUTF8());
+
+        const auto outputFile = getOutputFile(input, options);
+        auto writer = createWriter(formats, outputFile, sampleRate, numChannels);
+        if (writer == nullptr)
+        {
+            print("%s: can't write %s\n", name.toRawUTF8(), outputFile.getFullPathName().toRawUTF8());
+            processor.releaseResources();
+            return {};
+        }
+
+        const juce::int64 inputLength = reader->lengthInSamples;
+        const juce::int64 latency = processor.getLatencySamples();
+        const juce::int64 tail = options.renderTail ? (juce::int64)std::ceil(processor.getTailLengthSeconds() * sampleRate) : 0;
+        const juce::int64 outputLength = inputLength + tail;
+
+        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+        juce::MidiBuffer midi;
+        juce::int64 processed = 0;
+        juce::int64 written = 0;
+
+        {
+            // Finishes writing on the background thread when it goes out of scope
+            juce::AudioFormatWriter::ThreadedWriter threadedWriter(writer.release(), writerThread, writerBufferSize);
+
+            while (written < outputLength)
+            {
+                // Past the end of the input, silence flushes out the latency and the tail
+                const int toRead = (int)juce::jlimit<juce::int64>(0, blockSize, inputLength - processed);
+                buffer.clear();
+                if (toRead > 0)
+                    reader->read(&buffer, 0, toRead, processed, true, numChannels > 1);
+
+                processor.processBlock(buffer, midi);
+
+                // The first samples out are from before the input started
+                const int skip = (int)juce::jlimit<juce::int64>(0, blockSize, latency - processed);
+                const int count = (int)juce::jmin<juce::int64>(blockSize - skip, outputLength - written);
+                processed += blockSize;
+
+                if (count <= 0)
+                    continue;
+
+                const float* channels[] = { buffer.getReadPointer(0, skip),
+                                            numChannels > 1 ? buffer.getReadPointer(1, skip) : nullptr };
+
+                // Waits for the writer thread to catch up if the disk is slower than the render
+                while (! threadedWriter.write(channels, count))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+                written += count;
+            }
+        }
+
+        processor.releaseResources();
+
+        Result result;
+        result.succeeded = true;
+        result.audioSeconds = (double)inputLength / sampleRate;
+        result.renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        print("%-40s %9.2f s %9.3f s %8.1fx\n", name.toRawUTF8(), result.audioSeconds, result.renderSeconds,
+              result.audioSeconds / juce::jmax(1.0e-9, result.renderSeconds));
+        return result;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    Options options;
+    if (! parseArguments(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    const auto files = findInputFiles(options);
+    if (files.isEmpty())
+    {
+        std::printf("No audio files to render\n");
+        return 1;
+    }
+
+    const int numThreads = juce::jlimit(1, files.size(), options.numThreads > 0 ? options.numThreads
+                                                                               : juce::SystemStats::getNumCpus());
+
+    // Created up front so a bad state file or parameter stops everything before any work
+    std::vector<std::unique_ptr<VocalTransformerAudioProcessor>> processors;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        processors.push_back(createProcessor(options));
+        if (processors.back() == nullptr)
+            return 1;
+    }
+
+    std::printf("Rendering %d files on %d threads, %d-sample blocks\n\n", files.size(), numThreads, options.blockSize);
+    std::printf("%-40s %11s %11s %9s\n", "File", "Audio", "Render", "Realtime");
+
+    juce::TimeSliceThread writerThread("Batch renderer writer");
+    writerThread.startThread();
+
+    std::vector<Result> results((size_t)files.size());
+    std::atomic<int> nextFile { 0 };
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (auto& processor : processors)
+    {
+        workers.emplace_back([&, worker = processor.get()]
+        {
+            juce::AudioFormatManager formats;
+            formats.registerBasicFormats();
+
+            for (int file = nextFile++; file < files.size(); file = nextFile++)
+                results[(size_t)file] = renderFile(*worker, formats, writerThread, files[file], options);
+        });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    writerThread.stopThread(10000);
+
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double audioSeconds = 0.0;
+    double renderSeconds = 0.0;
+    int failed = 0;
+
+    for (const auto& result : results)
+    {
+        audioSeconds += result.audioSeconds;
+        renderSeconds += result.renderSeconds;
+        failed += result.succeeded ? 0 : 1;
+    }
+
+    // Per thread is what one processor manages on its own, overall includes running in parallel
+    std::printf("\n%d files, %.2f s of audio in %.3f s\n", files.size() - failed, audioSeconds, wallSeconds);
+    std::printf("Realtime factor: %.1fx overall, %.1fx per thread\n",
+                audioSeconds / juce::jmax(1.0e-9, wallSeconds), audioSeconds / juce::jmax(1.0e-9, renderSeconds));
+
+    if (failed > 0)
+        std::printf("%d files failed\n", failed);
+
+    return failed > 0 ? 1 : 0;
+}
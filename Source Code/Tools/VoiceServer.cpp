@@ -0,0 +1,427 @@
+// Drives a VoiceServer from a loopback stand-in for a network: finds how many
+// talkers the machine can transform at once without missing deadlines.
+// Built by the VoiceServer target in CMakeLists.txt, with the plugin's sources and
+// juce_audio_formats for --input and --record.
+//
+//     VoiceServer [options]
+//
+//     --streams <n>           runs this many streams once (default: searches for the most
+//                             that stay within the miss rate)
+//     --latency <ms>          deadline after each block arrives (default: 20)
+//     --block <n>             samples per block (default: 480, 10 ms at 48 kHz)
+//     --threads <n>           workers (default: one per core)
+//     --no-pin                lets workers run on any core
+//     --seconds <s>           length of each run (default: 5)
+//     --max-miss-rate <%>     late or dropped blocks allowed in a search (default: 0.1)
+//     --input <file>          talker audio, looped, each stream starting at a different
+//                             point (default: a synthetic voice at 48 kHz)
+//     --record <file>         writes stream 0's output as WAV, with --streams
+//     --state <file>          state saved by getStateInformation(), or preset XML
+//     --param <id>=<value>    sets a parameter to a plain value, after the state
+//
+// Each stream's blocks arrive in real time, one every block length, with the streams
+// spread evenly over the block period as independent talkers would be. A block is
+// due the latency after it arrives; one that isn't done by then counts as a miss.
+
+#include <JuceHeader.h>
+#include "VoiceServer.h"
+#include "../PluginProcessor.h"
+
+#include <cstdio>
+
+namespace
+{
+    constexpr int defaultBlockSize = 480;
+    constexpr double defaultLatencyMs = 20.0;
+    constexpr double defaultSeconds = 5.0;
+    constexpr double defaultMaxMissRate = 0.1;
+    constexpr int maxStreams = 4096;
+    constexpr double maxInputSeconds = 60.0;
+
+    struct Options
+    {
+        int numStreams = 0;
+        double latencyMs = defaultLatencyMs;
+        int blockSize = defaultBlockSize;
+        int numThreads = 0;
+        bool pinWorkers = true;
+        double seconds = defaultSeconds;
+        double maxMissRate = defaultMaxMissRate;
+        juce::File inputFile;
+        juce::File recordFile;
+        juce::File stateFile;
+        std::vector<std::pair<juce::String, float>> parameterValues;
+    };
+
+    struct Talker
+    {
+        juce::AudioBuffer<float> audio;     // mono, with its first block repeated at the end
+        double sampleRate = 48000.0;
+        int length = 0;                     // without the repeat
+    };
+
+    void printUsage()
+    {
+        std::printf("Usage: VoiceServer [--streams n] [--latency ms] [--block n] [--threads n] [--no-pin] [--seconds s]\n"
+                    "                   [--max-miss-rate %%] [--input file] [--record file] [--state file] [--param id=value]...\n");
+    }
+
+    bool parseArguments(int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const juce::String argument(argv[i]);
+            const bool hasValue = i + 1 < argc;
+            auto file = [&] { return juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]); };
+
+            if (argument == "--streams" && hasValue)
+                options.numStreams = juce::jlimit(1, maxStreams, juce::String(argv[++i]).getIntValue());
+            else if (argument == "--latency" && hasValue)
+                options.latencyMs = juce::jmax(0.1, juce::String(argv[++i]).getDoubleValue());
+            else if (argument == "--block" && hasValue)
+                options.blockSize = juce::jlimit(16, 1 << 14, juce::String(argv[++i]).getIntValue());
+            else if (argument == "--threads" && hasValue)
+                options.numThreads = juce::String(argv[++i]).getIntValue();
+            else if (argument == "--no-pin")
+                options.pinWorkers = false;
+            else if (argument == "--seconds" && hasValue)
+                options.seconds = juce::jmax(0.5, juce::String(argv[++i]).getDoubleValue());
+            else if (argument == "--max-miss-rate" && hasValue)
+                options.maxMissRate = juce::jmax(0.0, juce::String(argv[++i]).getDoubleValue());
+            else if (argument == "--input" && hasValue)
+                options.inputFile = file();
+            else if (argument == "--record" && hasValue)
+                options.recordFile = file();
+            else if (argument == "--state" && hasValue)
+                options.stateFile = file();
+            else if (argument == "--param" && hasValue)
+            {
+                const juce::String assignment(argv[++i]);
+                if (! assignment.containsChar('='))
+                    return false;
+                options.parameterValues.emplace_back(assignment.upToFirstOccurrenceOf("=", false, false),
+                                                     assignment.fromFirstOccurrenceOf("=", false, false).getFloatValue());
+            }
+            else
+                return false;
+        }
+
+        return true;
+    }
+
+    // The settings every stream gets, applied the way the plugin loads them
+    std::unique_ptr<VocalTransformerAudioProcessor> loadPreset(const Options& options)
+    {
+        auto processor = std::make_unique<VocalTransformerAudioProcessor>();
+
+        if (options.stateFile != juce::File())
+        {
+            juce::MemoryBlock state;
+            if (! options.stateFile.loadFileAsData(state))
+            {
+                std::printf("%s: can't read state\n", options.stateFile.getFullPathName().toRawUTF8());
+                return nullptr;
+            }
+
+            // Preset XML is wrapped up the way getStateInformation() stores it
+            if (auto xml = juce::parseXML(options.stateFile))
+            {
+                state.reset();
+                juce::AudioProcessor::copyXmlToBinary(*xml, state);
+            }
+
+            processor->setStateInformation(state.getData(), (int)state.getSize());
+        }
+
+        for (const auto& [id, value] : options.parameterValues)
+        {
+            auto* parameter = processor->parameters.getParameter(id);
+            if (parameter == nullptr)
+            {
+                std::printf("Unknown parameter: %s\n", id.toRawUTF8());
+                return nullptr;
+            }
+
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        }
+
+        return processor;
+    }
+
+    // Streams run the bare engine, with the preset's values copied in
+    std::unique_ptr<VocalTransformerEngine> createEngine(const VocalTransformerAudioProcessor& preset)
+    {
+        auto engine = std::make_unique<VocalTransformerEngine>();
+
+        for (int i = 0; i < NUM_PARAMETERS; ++i)
+        {
+            const auto parameter = (EngineParameter)i;
+            engine->setParameter(parameter, preset.parameters.getRawParameterValue(VocalTransformerEngine::getParameterInfo(parameter).id)->load());
+        }
+
+        engine->loadImpulseResponse(preset.getImpulseResponseFile());
+        return engine;
+    }
+
+    // A buzzy voice gliding between 110 and 220 Hz in four syllables a second
+    void synthesiseTalker(Talker& talker)
+    {
+        talker.sampleRate = 48000.0;
+        talker.length = (int)(4.0 * talker.sampleRate);
+        talker.audio.setSize(1, talker.length);
+
+        float* data = talker.audio.getWritePointer(0);
+        double phase = 0.0;
+
+        for (int i = 0; i < talker.length; ++i)
+        {
+            const double t = i / talker.sampleRate;
+            const double pitch = 165.0 + 55.0 * std::sin(juce::MathConstants<double>::twoPi * 0.25 * t)
+                                       + 3.0 * std::sin(juce::MathConstants<double>::twoPi * 5.5 * t);
+            phase += pitch / talker.sampleRate;
+
+            double sample = 0.0;
+            for (int harmonic = 1; harmonic * pitch < 8000.0; ++harmonic)
+                sample += std::sin(juce::MathConstants<double>::twoPi * harmonic * phase) / harmonic;
+
+            const double syllable = std::pow(std::sin(juce::MathConstants<double>::pi * std::fmod(t * 4.0, 1.0)), 2.0);
+            data[i] = (float)(0.2 * sample * syllable);
+        }
+    }
+
+    // Mixed down to mono
+    bool loadTalker(const juce::File& file, Talker& talker)
+    {
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+        if (reader == nullptr)
+            return false;
+
+        talker.sampleRate = reader->sampleRate;
+        talker.length = (int)juce::jmin<juce::int64>(reader->lengthInSamples, (juce::int64)(maxInputSeconds * reader->sampleRate));
+        if (talker.length <= 0)
+            return false;
+
+        juce::AudioBuffer<float> channels((int)reader->numChannels, talker.length);
+        reader->read(&channels, 0, talker.length, 0, true, true);
+
+        talker.audio.setSize(1, talker.length);
+        talker.audio.clear();
+        for (int c = 0; c < channels.getNumChannels(); ++c)
+            talker.audio.addFrom(0, 0, channels, c, 0, talker.length, 1.0f / (float)channels.getNumChannels());
+
+        return true;
+    }
+
+    // So any block can be read straight out of the buffer, even one that wraps around
+    void repeatFirstBlock(Talker& talker, int blockSize)
+    {
+        while (talker.length < blockSize)
+        {
+            talker.audio.setSize(1, talker.length * 2, true);
+            talker.audio.copyFrom(0, talker.length, talker.audio, 0, 0, talker.length);
+            talker.length *= 2;
+        }
+
+        talker.audio.setSize(1, talker.length + blockSize, true);
+        talker.audio.copyFrom(0, talker.length, talker.audio, 0, 0, blockSize);
+    }
+
+    std::unique_ptr<juce::AudioFormatWriter> createRecorder(const juce::File& file, double sampleRate)
+    {
+        if (! file.getParentDirectory().createDirectory())
+            return nullptr;
+
+        file.deleteFile();
+        std::unique_ptr<juce::FileOutputStream> stream(file.createOutputStream());
+        if (stream == nullptr)
+            return nullptr;
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), sampleRate, 1, 24, {}, 0));
+        if (writer != nullptr)
+            stream.release();   // owned by the writer now
+
+        return writer;
+    }
+
+    struct RunResult
+    {
+        VoiceServer::Stats stats;
+        double worstLatenessMs = 0.0;
+        int numWorkers = 0;
+
+        double missRate() const
+        {
+            const auto submitted = stats.blocks + stats.dropped;
+            return submitted > 0 ? 100.0 * (double)(stats.misses + stats.dropped) / (double)submitted : 0.0;
+        }
+    };
+
+    RunResult run(int numStreams, const Options& options, const VocalTransformerAudioProcessor& preset, const Talker& talker, bool record)
+    {
+        VoiceServer::Settings settings;
+        settings.sampleRate = talker.sampleRate;
+        settings.blockSize = options.blockSize;
+        settings.numChannels = 1;
+        settings.numWorkers = options.numThreads;
+        settings.pinWorkers = options.pinWorkers;
+
+        VoiceServer server(settings);
+        for (int i = 0; i < numStreams; ++i)
+            server.addStream(createEngine(preset));
+
+        // The loopback: rendered audio goes nowhere, apart from stream 0 when recording
+        juce::TimeSliceThread writerThread("Voice server recorder");
+        std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> recorder;
+
+        if (record)
+        {
+            if (auto writer = createRecorder(options.recordFile, talker.sampleRate))
+            {
+                writerThread.startThread();
+                recorder = std::make_unique<juce::AudioFormatWriter::ThreadedWriter>(writer.release(), writerThread, 1 << 17);
+                server.onBlockRendered = [&recorder](int stream, const juce::AudioBuffer<float>& output)
+                {
+                    const float* channels[] = { output.getReadPointer(0), nullptr };
+                    if (stream == 0)
+                        recorder->write(channels, output.getNumSamples());
+                };
+            }
+            else
+                std::printf("%s: can't write\n", options.recordFile.getFullPathName().toRawUTF8());
+        }
+
+        // Each stream starts reading the talker at a different point
+        std::vector<int> positions((size_t)numStreams);
+        for (int i = 0; i < numStreams; ++i)
+            positions[(size_t)i] = (int)((juce::int64)talker.length * i / numStreams);
+
+        const std::chrono::duration<double> period(options.blockSize / talker.sampleRate);
+        const auto latency = std::chrono::duration_cast<VoiceServer::Clock::duration>(std::chrono::duration<double, std::milli>(options.latencyMs));
+        const auto numBlocks = (juce::int64)(options.seconds / period.count());
+
+        server.start();
+        const auto start = VoiceServer::Clock::now() + std::chrono::milliseconds(20);
+
+        for (juce::int64 i = 0; i < numBlocks * numStreams; ++i)
+        {
+            const int stream = (int)(i % numStreams);
+            const auto block = i / numStreams;
+            const auto arrival = start + std::chrono::duration_cast<VoiceServer::Clock::duration>(
+                                             period * ((double)block + (double)stream / numStreams));
+
+            // Behind schedule, the blocks go straight in to catch up, as they would off a socket
+            if (arrival > VoiceServer::Clock::now())
+                std::this_thread::sleep_until(arrival);
+
+            auto& position = positions[(size_t)stream];
+            const float* input[] = { talker.audio.getReadPointer(0, position) };
+            server.submit(stream, input, arrival + latency);
+            position = (position + options.blockSize) % talker.length;
+        }
+
+        server.waitUntilIdle(10000);
+        server.stop();
+        recorder.reset();
+        writerThread.stopThread(10000);
+
+        RunResult result;
+        result.stats = server.getStats();
+        result.numWorkers = server.getNumWorkers();
+        for (int i = 0; i < numStreams; ++i)
+            result.worstLatenessMs = juce::jmax(result.worstLatenessMs, server.getStreamStats(i).worstLatenessMs);
+
+        std::printf("%7d %10llu %8.3f %% %8llu %10.2f ms %9.0f %% %10.1f\n", numStreams,
+                    (unsigned long long)result.stats.blocks, result.missRate(), (unsigned long long)result.stats.dropped,
+                    result.worstLatenessMs,
+                    100.0 * result.stats.busySeconds / juce::jmax(1.0e-9, result.stats.wallSeconds * result.numWorkers),
+                    result.stats.streamsPerCore());
+        return result;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    Options options;
+    if (! parseArguments(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Checked once up front, so a bad state file or parameter stops everything
+    const auto preset = loadPreset(options);
+    if (preset == nullptr)
+        return 1;
+
+    Talker talker;
+    if (options.inputFile == juce::File())
+        synthesiseTalker(talker);
+    else if (! loadTalker(options.inputFile, talker))
+    {
+        std::printf("%s: can't read\n", options.inputFile.getFullPathName().toRawUTF8());
+        return 1;
+    }
+
+    repeatFirstBlock(talker, options.blockSize);
+
+    const int numWorkers = options.numThreads > 0 ? options.numThreads : juce::SystemStats::getNumCpus();
+    std::printf("%d workers%s, %d-sample blocks at %.0f Hz (%.1f ms), %.1f ms deadline, %.1f s per run\n\n",
+                numWorkers, options.pinWorkers ? " pinned to cores" : "", options.blockSize, talker.sampleRate,
+                1000.0 * options.blockSize / talker.sampleRate, options.latencyMs, options.seconds);
+    std::printf("%7s %10s %10s %8s %13s %11s %10s\n", "Streams", "Blocks", "Missed", "Dropped", "Worst late", "Busy",
+                "Per core");
+
+    if (options.numStreams > 0)
+    {
+        const auto result = run(options.numStreams, options, *preset, talker, options.recordFile != juce::File());
+        return result.missRate() <= options.maxMissRate ? 0 : 1;
+    }
+
+    // Doubles the streams until the deadline can't be met, then narrows it down to 5%
+    auto meetsDeadline = [&](int numStreams)
+    {
+        return run(numStreams, options, *preset, talker, false).missRate() <= options.maxMissRate;
+    };
+
+    int best = 0;
+    int failed = 0;
+
+    for (int numStreams = numWorkers; numStreams <= maxStreams; numStreams *= 2)
+    {
+        if (! meetsDeadline(numStreams))
+        {
+            failed = numStreams;
+            break;
+        }
+
+        best = numStreams;
+    }
+
+    if (failed == 0)
+    {
+        std::printf("\nStill meeting the deadline at %d streams, the most this tries\n", best);
+        return 0;
+    }
+
+    while (failed - best > juce::jmax(1, best / 20))
+    {
+        const int numStreams = (best + failed) / 2;
+        (meetsDeadline(numStreams) ? best : failed) = numStreams;
+    }
+
+    if (best == 0)
+    {
+        std::printf("\nCan't meet a %.1f ms deadline even with one stream\n", options.latencyMs);
+        return 1;
+    }
+
+    std::printf("\n%d streams within %.1f ms on %d workers: %.1f streams per core\n", best, options.latencyMs, numWorkers,
+                (double)best / numWorkers);
+    return 0;
+}
@@ -0,0 +1,384 @@
+#pragma once
+
+// Runs many independent copies of the transformer at once, one per talker, for
+// servers rather than DAW inserts: game voice chat, call centre demos and the like.
+//
+// Each stream owns a prepared engine and one block of audio. Whoever receives a
+// talker's audio hands a block to submit() with a deadline. A pool of workers renders
+// the blocks, earliest deadline first, and calls onBlockRendered with the result.
+//
+// Every stream has a home worker, so its engine's state usually stays in that
+// core's cache, and workers can be pinned to cores. A worker whose own queue runs dry
+// steals the earliest-deadline job from the others, so one busy core doesn't make its
+// streams late while the rest sit idle. Queues are short and locked only to push or
+// pop, never while rendering; nothing allocates once the server has started.
+//
+// A block that finishes after its deadline counts as a miss for its stream. A block
+// submitted while the stream's last one is still queued or rendering is dropped, as
+// a jitter buffer would, and counted too.
+
+#include <JuceHeader.h>
+#include "../VocalTransformerEngine.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class VoiceServer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 480;            // 10 ms at 48 kHz
+        int numChannels = 1;
+        int numWorkers = 0;             // 0 for one per core
+        bool pinWorkers = true;         // worker n runs only on core n
+    };
+
+    struct StreamStats
+    {
+        juce::uint32 blocks = 0;        // rendered
+        juce::uint32 misses = 0;        // rendered after their deadline
+        juce::uint32 dropped = 0;       // submitted while the last block was still pending
+        double worstLatenessMs = 0.0;   // past the deadline
+    };
+
+    struct Stats
+    {
+        juce::uint64 blocks = 0;
+        juce::uint64 misses = 0;
+        juce::uint64 dropped = 0;
+        double audioSeconds = 0.0;      // rendered, summed over all streams
+        double busySeconds = 0.0;       // summed over all workers
+        double wallSeconds = 0.0;       // since start()
+
+        // How many streams one fully busy core keeps up with, ignoring deadlines
+        double streamsPerCore() const
+        {
+            return busySeconds > 0.0 ? audioSeconds / busySeconds : 0.0;
+        }
+    };
+
+    explicit VoiceServer(const Settings& newSettings) : settings(newSettings)
+    {
+        if (settings.numWorkers <= 0)
+            settings.numWorkers = juce::SystemStats::getNumCpus();
+    }
+
+    ~VoiceServer()
+    {
+        stop();
+    }
+
+    // Before start(). Prepares the engine for the server's format, waits for any
+    // impulse response to load and returns the new stream's index.
+    int addStream(std::unique_ptr<VocalTransformerEngine> engine)
+    {
+        jassert(! running.load());
+
+        engine->prepare(settings.sampleRate, settings.blockSize, settings.numChannels);
+        engine->waitUntilReady(30000);
+
+        auto stream = std::make_unique<Stream>();
+        stream->engine = std::move(engine);
+        stream->buffer.setSize(settings.numChannels, settings.blockSize);
+        stream->homeWorker = (int)streams.size() % settings.numWorkers;
+        streams.push_back(std::move(stream));
+        return (int)streams.size() - 1;
+    }
+
+    int getNumStreams() const { return (int)streams.size(); }
+    int getNumWorkers() const { return settings.numWorkers; }
+    const Settings& getSettings() const { return settings; }
+
+    // Called on a worker thread with each rendered block. The buffer belongs to the
+    // stream and is only valid until the call returns. Set it before start().
+    std::function<void(int stream, const juce::AudioBuffer<float>& output)> onBlockRendered;
+
+    void start()
+    {
+        if (running.exchange(true))
+            return;
+
+        workers.clear();
+        for (int i = 0; i < settings.numWorkers; ++i)
+        {
+            workers.push_back(std::make_unique<Worker>());
+            workers.back()->jobs.reserve(streams.size());   // a stream has one job pending at most
+        }
+
+        startTime = Clock::now();
+        for (int i = 0; i < settings.numWorkers; ++i)
+            workers[(size_t)i]->thread = std::thread([this, i] { runWorker(i); });
+    }
+
+    // Jobs still queued are abandoned
+    void stop()
+    {
+        if (! running.exchange(false))
+            return;
+
+        for (auto& worker : workers)
+        {
+            {
+                const std::lock_guard<std::mutex> lock(worker->lock);
+                worker->woken = true;
+            }
+            worker->wake.notify_one();
+        }
+
+        for (auto& worker : workers)
+            worker->thread.join();
+
+        stopTime = Clock::now();
+    }
+
+    // Any one thread at a time. Copies a block of input for the stream, which is
+    // settings.blockSize samples per channel, and queues it. Returns false, and counts
+    // a dropped block, if the stream's last block hasn't been rendered yet.
+    bool submit(int streamIndex, const float* const* input, Clock::time_point deadline)
+    {
+        auto& stream = *streams[(size_t)streamIndex];
+
+        if (stream.pending.exchange(true, std::memory_order_acquire))
+        {
+            stream.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        for (int c = 0; c < settings.numChannels; ++c)
+            std::copy(input[c], input[c] + settings.blockSize, stream.buffer.getWritePointer(c));
+
+        auto& home = *workers[(size_t)stream.homeWorker];
+        {
+            const std::lock_guard<std::mutex> lock(home.lock);
+            home.jobs.push_back({ deadline, streamIndex });
+            std::push_heap(home.jobs.begin(), home.jobs.end(), laterDeadline);
+            home.woken = true;
+        }
+        home.wake.notify_one();
+
+        // If the home worker is busy, an idle one can take it sooner
+        if (! home.idle.load(std::memory_order_relaxed))
+            wakeIdleWorker();
+
+        return true;
+    }
+
+    // Waits until every submitted block has been rendered, or the timeout runs out
+    bool waitUntilIdle(int timeoutMilliseconds)
+    {
+        const auto timeout = Clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+
+        for (;;)
+        {
+            const bool anyPending = std::any_of(streams.begin(), streams.end(), [](const auto& stream)
+            {
+                return stream->pending.load(std::memory_order_acquire);
+            });
+
+            if (! anyPending)
+                return true;
+
+            if (Clock::now() > timeout)
+                return false;
+
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    // Any thread. Figures from a stream that is rendering can be one block out.
+    StreamStats getStreamStats(int streamIndex) const
+    {
+        const auto& stream = *streams[(size_t)streamIndex];
+
+        StreamStats stats;
+        stats.blocks = stream.blocks.load(std::memory_order_relaxed);
+        stats.misses = stream.misses.load(std::memory_order_relaxed);
+        stats.dropped = stream.dropped.load(std::memory_order_relaxed);
+        stats.worstLatenessMs = stream.worstLatenessUs.load(std::memory_order_relaxed) * 1.0e-3;
+        return stats;
+    }
+
+    Stats getStats() const
+    {
+        Stats stats;
+
+        for (int i = 0; i < getNumStreams(); ++i)
+        {
+            const auto stream = getStreamStats(i);
+            stats.blocks += stream.blocks;
+            stats.misses += stream.misses;
+            stats.dropped += stream.dropped;
+        }
+
+        for (const auto& worker : workers)
+            stats.busySeconds += (double)worker->busyNs.load(std::memory_order_relaxed) * 1.0e-9;
+
+        stats.audioSeconds = (double)stats.blocks * settings.blockSize / settings.sampleRate;
+        stats.wallSeconds = std::chrono::duration<double>((running.load() ? Clock::now() : stopTime) - startTime).count();
+        return stats;
+    }
+
+private:
+    struct Job
+    {
+        Clock::time_point deadline;
+        int stream;
+    };
+
+    // For a min-heap on the deadline
+    static bool laterDeadline(const Job& a, const Job& b)
+    {
+        return a.deadline > b.deadline;
+    }
+
+    struct Stream
+    {
+        std::unique_ptr<VocalTransformerEngine> engine;
+        juce::AudioBuffer<float> buffer;    // input in, output out
+        int homeWorker = 0;
+
+        // Set by submit(), cleared once the block is rendered. Only one worker touches
+        // the stream in between, which is what makes moving it between workers safe.
+        std::atomic<bool> pending { false };
+
+        std::atomic<juce::uint32> blocks { 0 };
+        std::atomic<juce::uint32> misses { 0 };
+        std::atomic<juce::uint32> dropped { 0 };
+        std::atomic<juce::uint32> worstLatenessUs { 0 };
+    };
+
+    struct Worker
+    {
+        std::mutex lock;
+        std::condition_variable wake;
+        std::vector<Job> jobs;      // heap, earliest deadline on top
+        bool woken = false;
+        std::atomic<bool> idle { false };
+        std::atomic<juce::uint64> busyNs { 0 };
+        std::thread thread;
+    };
+
+    void runWorker(int index)
+    {
+        auto& worker = *workers[(size_t)index];
+
+        if (settings.pinWorkers && index < 32)
+            juce::Thread::setCurrentThreadAffinityMask((juce::uint32)1 << index);
+
+        juce::ScopedNoDenormals noDenormals;
+
+        while (running.load(std::memory_order_relaxed))
+        {
+            Job job;
+            if (popJob(worker, job) || stealJob(index, job))
+            {
+                render(worker, job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(worker.lock);
+            worker.idle.store(true, std::memory_order_relaxed);
+
+            // The timeout covers a wake-up meant for stealing that raced with going idle
+            worker.wake.wait_for(lock, std::chrono::milliseconds(1), [&] { return worker.woken; });
+            worker.woken = false;
+            worker.idle.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    static bool popJob(Worker& worker, Job& job)
+    {
+        const std::lock_guard<std::mutex> lock(worker.lock);
+        if (worker.jobs.empty())
+            return false;
+
+        std::pop_heap(worker.jobs.begin(), worker.jobs.end(), laterDeadline);
+        job = worker.jobs.back();
+        worker.jobs.pop_back();
+        return true;
+    }
+
+    // Takes the earliest deadline any other worker has queued
+    bool stealJob(int thief, Job& job)
+    {
+        Worker* victim = nullptr;
+        Clock::time_point earliest = Clock::time_point::max();
+
+        for (int i = 1; i < settings.numWorkers; ++i)
+        {
+            auto& other = *workers[(size_t)((thief + i) % settings.numWorkers)];
+            const std::lock_guard<std::mutex> lock(other.lock);
+
+            if (! other.jobs.empty() && other.jobs.front().deadline < earliest)
+            {
+                earliest = other.jobs.front().deadline;
+                victim = &other;
+            }
+        }
+
+        // Someone may have got there first, in which case take the next one
+        return victim != nullptr && popJob(*victim, job);
+    }
+
+    void wakeIdleWorker()
+    {
+        for (auto& worker : workers)
+        {
+            if (worker->idle.load(std::memory_order_relaxed))
+            {
+                {
+                    const std::lock_guard<std::mutex> lock(worker->lock);
+                    worker->woken = true;
+                }
+                worker->wake.notify_one();
+                return;
+            }
+        }
+    }
+
+    void render(Worker& worker, const Job& job)
+    {
+        auto& stream = *streams[(size_t)job.stream];
+        const auto start = Clock::now();
+
+        stream.engine->process(stream.buffer, settings.numChannels);
+
+        const auto finish = Clock::now();
+        if (onBlockRendered)
+            onBlockRendered(job.stream, stream.buffer);
+
+        // Only the worker holding the stream writes these, so no read-modify-write
+        stream.blocks.store(stream.blocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if (finish > job.deadline)
+        {
+            const auto latenessUs = (juce::uint32)juce::jmin<juce::int64>(
+                std::chrono::duration_cast<std::chrono::microseconds>(finish - job.deadline).count(), 0xffffffff);
+
+            stream.misses.store(stream.misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (latenessUs > stream.worstLatenessUs.load(std::memory_order_relaxed))
+                stream.worstLatenessUs.store(latenessUs, std::memory_order_relaxed);
+        }
+
+        const auto busy = (juce::uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+        worker.busyNs.store(worker.busyNs.load(std::memory_order_relaxed) + busy, std::memory_order_relaxed);
+
+        stream.pending.store(false, std::memory_order_release);
+    }
+
+    Settings settings;
+    std::vector<std::unique_ptr<Stream>> streams;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> running { false };
+    Clock::time_point startTime, stopTime;
+
+    JUCE_DECLARE_NON_COPYABLE(VoiceServer)
+};
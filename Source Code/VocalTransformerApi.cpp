@@ -0,0 +1,199 @@
+#include "VocalTransformerApi.h"
+#include "StreamingEngine.h"
+
+// The C enum mirrors EngineParameter, value for value
+static_assert((int)VT_PARAM_CHARACTER == (int)PARAM_CHARACTER, "");
+static_assert((int)VT_PARAM_CHARACTER_STRENGTH == (int)PARAM_CHARACTER_STRENGTH, "");
+static_assert((int)VT_PARAM_PITCH_SHIFT == (int)PARAM_PITCH_SHIFT, "");
+static_assert((int)VT_PARAM_FORMANT_SHIFT == (int)PARAM_FORMANT_SHIFT, "");
+static_assert((int)VT_PARAM_VOICE_COUNT == (int)PARAM_VOICE_COUNT, "");
+static_assert((int)VT_PARAM_DETUNE == (int)PARAM_DETUNE, "");
+static_assert((int)VT_PARAM_REVERB == (int)PARAM_REVERB, "");
+static_assert((int)VT_PARAM_REVERB_ROOM_SIZE == (int)PARAM_REVERB_ROOM_SIZE, "");
+static_assert((int)VT_PARAM_REVERB_DAMPING == (int)PARAM_REVERB_DAMPING, "");
+static_assert((int)VT_PARAM_REVERB_DECAY == (int)PARAM_REVERB_DECAY, "");
+static_assert((int)VT_PARAM_REVERB_MODE == (int)PARAM_REVERB_MODE, "");
+static_assert((int)VT_PARAM_DISTORTION == (int)PARAM_DISTORTION, "");
+static_assert((int)VT_PARAM_LOW_CUT == (int)PARAM_LOW_CUT, "");
+static_assert((int)VT_PARAM_TONE == (int)PARAM_TONE, "");
+static_assert((int)VT_PARAM_QUALITY_MODE == (int)PARAM_QUALITY_MODE, "");
+static_assert((int)VT_PARAM_DISTORTION_OVERSAMPLING == (int)PARAM_DISTORTION_OVERSAMPLING, "");
+static_assert((int)VT_PARAM_DISTORTION_ANTIALIAS == (int)PARAM_DISTORTION_ANTIALIAS, "");
+static_assert((int)VT_PARAM_LATENCY_PROFILE == (int)PARAM_LATENCY_PROFILE, "");
+static_assert((int)VT_PARAM_REDUCED_RATE == (int)PARAM_REDUCED_RATE, "");
+static_assert((int)VT_NUM_PARAMS == (int)NUM_PARAMETERS, "");
+static_assert(std::is_same<int16_t, juce::int16>::value, "");
+
+struct vt_engine
+{
+    VocalTransformerEngine engine;
+    StreamingEngine stream { engine };
+    bool prepared = false;
+    bool streaming = false;
+    int maxBlockSize = 0;
+};
+
+namespace
+{
+    bool isValid(vt_param param)
+    {
+        return param >= 0 && param < VT_NUM_PARAMS;
+    }
+}
+
+vt_engine* vt_create(void)
+{
+    // Nothing may throw across the C boundary
+    try
+    {
+        return new vt_engine();
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void vt_destroy(vt_engine* engine)
+{
+    delete engine;
+}
+
+int vt_prepare(vt_engine* engine, double sample_rate, int max_block_size, int num_channels)
+{
+    if (engine == nullptr || sample_rate <= 0.0 || max_block_size <= 0 || num_channels < 1 || num_channels > 2)
+        return 0;
+
+    try
+    {
+        engine->engine.prepare(sample_rate, max_block_size, num_channels);
+        engine->prepared = true;
+        engine->streaming = false;
+        engine->maxBlockSize = max_block_size;
+        return 1;
+    }
+    catch (...)
+    {
+        engine->prepared = false;
+        engine->streaming = false;
+        return 0;
+    }
+}
+
+void vt_process(vt_engine* engine, float* const* channels, int num_channels, int num_samples)
+{
+    // A streaming engine is only driven through its FIFOs, see vt_process_stream()
+    if (engine == nullptr || ! engine->prepared || engine->streaming || channels == nullptr || num_channels <= 0 || num_samples <= 0)
+        return;
+
+    // Longer calls are split up rather than overrunning what was prepared
+    std::array<float*, 2> chunk {};
+    const int channelsToProcess = juce::jmin(num_channels, (int)chunk.size());
+
+    for (int start = 0; start < num_samples; start += engine->maxBlockSize)
+    {
+        for (int c = 0; c < channelsToProcess; ++c)
+            chunk[(size_t)c] = channels[c] + start;
+
+        engine->engine.process(chunk.data(), channelsToProcess, juce::jmin(engine->maxBlockSize, num_samples - start));
+    }
+}
+
+void vt_process_interleaved_s16(vt_engine* engine, const int16_t* input, int16_t* output, int num_frames)
+{
+    if (engine == nullptr || ! engine->prepared || engine->streaming || input == nullptr || output == nullptr || num_frames <= 0)
+        return;
+
+    engine->engine.processInterleaved(input, output, num_frames);
+}
+
+void vt_process_interleaved_f32(vt_engine* engine, const float* input, float* output, int num_frames)
+{
+    if (engine == nullptr || ! engine->prepared || engine->streaming || input == nullptr || output == nullptr || num_frames <= 0)
+        return;
+
+    engine->engine.processInterleaved(input, output, num_frames);
+}
+
+int vt_prepare_stream(vt_engine* engine, double sample_rate, int block_size, int num_channels)
+{
+    if (engine == nullptr || sample_rate <= 0.0 || block_size <= 0 || num_channels < 1 || num_channels > 2)
+        return 0;
+
+    try
+    {
+        engine->stream.prepare(sample_rate, num_channels, block_size);
+        engine->prepared = true;
+        engine->streaming = true;
+        engine->maxBlockSize = block_size;
+        return 1;
+    }
+    catch (...)
+    {
+        engine->prepared = false;
+        engine->streaming = false;
+        return 0;
+    }
+}
+
+void vt_process_stream(vt_engine* engine, const float* const* input, float* const* output, int num_samples)
+{
+    if (engine == nullptr || ! engine->streaming || input == nullptr || output == nullptr || num_samples <= 0)
+        return;
+
+    engine->stream.process(input, output, num_samples);
+}
+
+int vt_get_stream_latency_samples(const vt_engine* engine)
+{
+    return engine != nullptr && engine->streaming ? engine->stream.getLatencySamples() : 0;
+}
+
+int vt_set_param(vt_engine* engine, vt_param param, float value)
+{
+    if (engine == nullptr || ! isValid(param))
+        return 0;
+
+    engine->engine.setParameter((EngineParameter)param, value);
+    return 1;
+}
+
+float vt_get_param(const vt_engine* engine, vt_param param)
+{
+    if (engine == nullptr || ! isValid(param))
+        return 0.0f;
+
+    return engine->engine.getParameter((EngineParameter)param);
+}
+
+int vt_get_latency_samples(const vt_engine* engine)
+{
+    return engine != nullptr ? engine->engine.getLatencySamples() : 0;
+}
+
+double vt_get_tail_seconds(const vt_engine* engine)
+{
+    return engine != nullptr ? engine->engine.getTailLengthSeconds() : 0.0;
+}
+
+int vt_is_prepare_needed(const vt_engine* engine)
+{
+    return engine != nullptr && engine->engine.isPrepareNeeded() ? 1 : 0;
+}
+
+void vt_load_impulse_response(vt_engine* engine, const char* path)
+{
+    if (engine == nullptr)
+        return;
+
+    const auto file = path != nullptr && path[0] != 0 ? juce::File(juce::String::fromUTF8(path)) : juce::File();
+    engine->engine.loadImpulseResponse(file);
+}
+
+int vt_wait_until_ready(vt_engine* engine, int timeout_ms)
+{
+    if (engine == nullptr || ! engine->prepared)
+        return 0;
+
+    return engine->engine.waitUntilReady(timeout_ms) ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+#ifndef VOCAL_TRANSFORMER_API_H
+#define VOCAL_TRANSFORMER_API_H
+
+/*
+    Plain C interface to the transformer's DSP (see VocalTransformerEngine.h), for
+    servers and benchmarks that embed it without a plugin host. CMakeLists.txt builds
+    it as the VocalTransformerEngine static library, with the JUCE modules it needs
+    compiled in, and with VT_BUILD_SHARED_API as the VocalTransformerApi shared one.
+
+    Audio is processed in place, in caller-owned planar float channels, with no
+    copies. vt_set_param() is safe from any thread. Everything else on one engine is
+    called from one thread at a time, and vt_prepare() never while vt_process() runs.
+
+        vt_engine* engine = vt_create();
+        vt_set_param(engine, VT_PARAM_CHARACTER, 2.0f);     // Alien
+        vt_prepare(engine, 48000.0, 480, 1);
+
+        float* channels[] = { samples };
+        vt_process(engine, channels, 1, 480);               // every 10 ms
+
+        vt_destroy(engine);
+*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32) && defined(VT_BUILD_SHARED)
+ #define VT_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(VT_USE_SHARED)
+ #define VT_API __declspec(dllimport)
+#elif defined(__GNUC__) && defined(VT_BUILD_SHARED)
+ #define VT_API __attribute__((visibility("default")))
+#else
+ #define VT_API
+#endif
+
+typedef struct vt_engine vt_engine;
+
+/* Values are in the plugin's units; ranges are in VocalTransformerEngine.cpp */
+typedef enum vt_param
+{
+    VT_PARAM_CHARACTER = 0,             /* 0 Normal, 1 Robot, 2 Alien, 3 Child, 4 Giant, 5 Elder, 6 Choir */
+    VT_PARAM_CHARACTER_STRENGTH,        /* 0 to 1 */
+    VT_PARAM_PITCH_SHIFT,               /* semitones, -12 to 12 */
+    VT_PARAM_FORMANT_SHIFT,             /* 0 = low, 0.5 = neutral, 1 = high */
+    VT_PARAM_VOICE_COUNT,               /* 1 to 64 */
+    VT_PARAM_DETUNE,                    /* 0 to 1 */
+    VT_PARAM_REVERB,                    /* wet amount, 0 to 1 */
+    VT_PARAM_REVERB_ROOM_SIZE,          /* 0 to 1 */
+    VT_PARAM_REVERB_DAMPING,            /* 0 to 1 */
+    VT_PARAM_REVERB_DECAY,              /* seconds, 0.2 to 10 */
+    VT_PARAM_REVERB_MODE,               /* 0 algorithmic, 1 convolution */
+    VT_PARAM_DISTORTION,                /* 0 to 1 */
+    VT_PARAM_LOW_CUT,                   /* Hz, 20 to 1000 */
+    VT_PARAM_TONE,                      /* 0 = dark, 0.5 = flat, 1 = bright */
+    VT_PARAM_QUALITY_MODE,              /* 0 low latency, 1 high quality */
+    VT_PARAM_DISTORTION_OVERSAMPLING,   /* 0 off, 1 2x, 2 4x */
+    VT_PARAM_DISTORTION_ANTIALIAS,      /* 0 or 1 */
+    VT_PARAM_LATENCY_PROFILE,           /* 0 live, 1 broadcast, 2 offline; takes effect at vt_prepare() */
+    VT_PARAM_REDUCED_RATE,              /* 0 or 1: pitch, formant and voices at ~24 kHz; takes effect at vt_prepare() */
+    VT_NUM_PARAMS
+} vt_param;
+
+/* Returns NULL if the engine can't be created */
+VT_API vt_engine* vt_create(void);
+VT_API void vt_destroy(vt_engine* engine);
+
+/* Allocates everything vt_process() needs. Returns 0 for bad arguments. */
+VT_API int vt_prepare(vt_engine* engine, double sample_rate, int max_block_size, int num_channels);
+
+/* In place. Calls longer than max_block_size are processed in several pieces. */
+VT_API void vt_process(vt_engine* engine, float* const* channels, int num_channels, int num_samples);
+
+/* Interleaved frames with the channel count given to vt_prepare(), e.g. 20 ms of
+   16-bit PCM from a telephony stack, of any length and with no added latency.
+   input and output may be the same array. int16 output is rounded and clipped. */
+VT_API void vt_process_interleaved_s16(vt_engine* engine, const int16_t* input, int16_t* output, int num_frames);
+VT_API void vt_process_interleaved_f32(vt_engine* engine, const float* input, float* output, int num_frames);
+
+/* Streaming instead of vt_prepare()/vt_process(): chunks of any length, run
+   internally in blocks of block_size (64 or 128 keep the working set in L1).
+   Adds block_size - 1 samples of latency, which vt_get_stream_latency_samples()
+   includes. input and output may be the same channels. Until the next vt_prepare(),
+   vt_process() and the interleaved calls do nothing, so they can't upset the
+   stream's timing. */
+VT_API int vt_prepare_stream(vt_engine* engine, double sample_rate, int block_size, int num_channels);
+VT_API void vt_process_stream(vt_engine* engine, const float* const* input, float* const* output, int num_samples);
+VT_API int vt_get_stream_latency_samples(const vt_engine* engine);
+
+/* Out-of-range values are clamped. Returns 0 for an unknown parameter. The
+   convolution reverb builds its impulse response on a thread that vt_prepare(),
+   vt_prepare_stream() or vt_wait_until_ready() starts, so select it before one of them. */
+VT_API int vt_set_param(vt_engine* engine, vt_param param, float value);
+VT_API float vt_get_param(const vt_engine* engine, vt_param param);
+
+/* Both follow the settings and can change in vt_process() */
+VT_API int vt_get_latency_samples(const vt_engine* engine);
+VT_API double vt_get_tail_seconds(const vt_engine* engine);
+
+/* Non-zero once the latency profile or reduced rate has changed and vt_prepare() is due */
+VT_API int vt_is_prepare_needed(const vt_engine* engine);
+
+/* UTF-8 path to an impulse response for the convolution reverb, loaded in the
+   background. NULL or "" goes back to the character's built-in room. */
+VT_API void vt_load_impulse_response(vt_engine* engine, const char* path);
+
+/* For offline use: waits until background loading is done. Returns 0 on timeout. */
+VT_API int vt_wait_until_ready(vt_engine* engine, int timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
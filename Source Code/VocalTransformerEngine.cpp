@@ -0,0 +1,587 @@
+#include "VocalTransformerEngine.h"
+
+//==============================================================================
+const VocalTransformerEngine::ParameterInfo& VocalTransformerEngine::getParameterInfo(EngineParameter parameter)
+{
+    // Ranges and defaults match the plugin's parameter layout
+    static const std::array<ParameterInfo, NUM_PARAMETERS> parameters {{
+        { "character",                  0.0f, (float)(NUM_CHARACTERS - 1), NORMAL },
+        { "character_strength",         0.0f, 1.0f, 1.0f },
+        { "pitch_shift",              -12.0f, 12.0f, 0.0f },
+        { "formant_shift",              0.0f, 1.0f, 0.5f },
+        { "voice_count",                1.0f, 64.0f, 1.0f },
+        { "detune",                     0.0f, 1.0f, 0.0f },
+        { "reverb",                     0.0f, 1.0f, 0.2f },
+        { "reverb_room_size",           0.0f, 1.0f, 0.5f },
+        { "reverb_damping",             0.0f, 1.0f, 0.5f },
+        { "reverb_decay",               0.2f, 10.0f, 1.8f },
+        { "reverb_mode",                0.0f, (float)(NUM_REVERB_MODES - 1), REVERB_ALGORITHMIC },
+        { "distortion",                 0.0f, 1.0f, 0.0f },
+        { "low_cut",                   20.0f, 1000.0f, 20.0f },
+        { "tone",                       0.0f, 1.0f, 0.5f },
+        { "quality_mode",               0.0f, (float)(NUM_QUALITY_MODES - 1), LOW_LATENCY },
+        { "distortion_oversampling",    0.0f, (float)(NUM_OVERSAMPLING_FACTORS - 1), OVERSAMPLING_2X },
+        { "distortion_antialias",       0.0f, 1.0f, 1.0f },
+        { "latency_profile",            0.0f, (float)(NUM_LATENCY_PROFILES - 1), PROFILE_BROADCAST },
+        { "reduced_rate",               0.0f, 1.0f, 0.0f },
+    }};
+    
+    return parameters[(size_t)juce::jlimit(0, NUM_PARAMETERS - 1, (int)parameter)];
+}
+
+VocalTransformerEngine::VocalTransformerEngine()
+{
+    initializeCharacterPresets();
+    
+    for (int i = 0; i < NUM_PARAMETERS; ++i)
+    {
+        parameterValues[(size_t)i] = getParameterInfo((EngineParameter)i).defaultValue;
+        parameterSources[(size_t)i] = &parameterValues[(size_t)i];
+    }
+    
+    spectralEngine.addStage(&spectralPitchShifter);
+    spectralEngine.addStage(&spectralFormantShifter);
+}
+
+void VocalTransformerEngine::initializeCharacterPresets()
+{
+    // Normal voice
+    characterPresets[NORMAL] = { 0.0f, 0.5f, 1, 0.0f, 0.2f };
+    
+    // Robot voice
+    characterPresets[ROBOT] = { -2.0f, 0.5f, 1, 0.0f, 0.1f, ConvolutionReverb::metalTube };
+    
+    // Alien voice
+    characterPresets[ALIEN] = { 3.0f, 0.7f, 2, 0.7f, 0.6f };
+    
+    // Child voice
+    characterPresets[CHILD] = { 4.0f, 0.8f, 1, 0.2f, 0.3f };
+    
+    // Giant voice
+    characterPresets[GIANT] = { -6.0f, 0.2f, 1, 0.0f, 0.5f };
+    
+    // Elder voice
+    characterPresets[ELDER] = { -1.0f, 0.3f, 1, 0.3f, 0.4f };
+    
+    // Choir voice - a full ensemble
+    characterPresets[CHOIR] = { 0.0f, 0.5f, 48, 0.4f, 0.8f, ConvolutionReverb::cathedral };
+}
+
+VocalTransformerEngine::DspTargets VocalTransformerEngine::readUserTargets() const
+{
+    DspTargets user;
+    user.pitchShift = readParameter(PARAM_PITCH_SHIFT);
+    user.formantShift = readParameter(PARAM_FORMANT_SHIFT);
+    user.voiceCount = readParameter(PARAM_VOICE_COUNT);
+    user.detune = readParameter(PARAM_DETUNE);
+    user.reverb = readParameter(PARAM_REVERB);
+    return user;
+}
+
+void VocalTransformerEngine::setParameter(EngineParameter parameter, float value)
+{
+    const auto& info = getParameterInfo(parameter);
+    parameterSources[(size_t)parameter]->store(juce::jlimit(info.minimum, info.maximum, value));
+}
+
+float VocalTransformerEngine::getParameter(EngineParameter parameter) const
+{
+    return readParameter(parameter);
+}
+
+void VocalTransformerEngine::bindParameter(EngineParameter parameter, std::atomic<float>* source)
+{
+    parameterSources[(size_t)parameter] = source != nullptr ? source : &parameterValues[(size_t)parameter];
+}
+
+bool VocalTransformerEngine::isPrepareNeeded() const
+{
+    return (int)readParameter(PARAM_LATENCY_PROFILE) != activeProfile
+        || (readParameter(PARAM_REDUCED_RATE) >= 0.5f) != activeReducedRate;
+}
+
+//==============================================================================
+void VocalTransformerEngine::prepare(double newSampleRate, int newMaximumBlockSize, int newNumChannels)
+{
+    sampleRate = newSampleRate;
+    maximumBlockSize = juce::jmax(1, newMaximumBlockSize);
+    numChannels = juce::jmax(1, newNumChannels);
+    
+    // Prepare DSP modules
+    juce::dsp::ProcessSpec spec;
+    spec.sampleRate = sampleRate;
+    spec.maximumBlockSize = (juce::uint32)maximumBlockSize;
+    spec.numChannels = (juce::uint32)numChannels;
+    
+    // Window sizes and partitioning for the latency profile
+    activeProfile = juce::jlimit(0, NUM_LATENCY_PROFILES - 1, (int)readParameter(PARAM_LATENCY_PROFILE));
+    const ProfileSettings& profile = getProfileSettings(activeProfile);
+    
+    pitchTracker.setFrequencyRange(profile.lowestPitch * 0.75f, 1000.0f);
+    pitchShifter.setLowestPitch(profile.lowestPitch);
+    spectralEngine.setResolution(profile.stftOrderOffset, profile.stftOverlap);
+    convolutionReverb.setHeadSize(profile.reverbHeadSize);
+    
+    // The voice band's stages only ever see one slice at a time, at their own rate
+    activeReducedRate = readParameter(PARAM_REDUCED_RATE) >= 0.5f;
+    voiceBandFactor = activeReducedRate ? VoiceBandSplitter::getFactorForRate(sampleRate) : 1;
+    
+    juce::dsp::ProcessSpec voiceSpec = spec;
+    if (voiceBandFactor > 1) {
+        voiceSpec.sampleRate = sampleRate / voiceBandFactor;
+        voiceSpec.maximumBlockSize = (juce::uint32)(controlBlockSize / voiceBandFactor + 1);
+    }
+    
+    pitchTracker.prepare(voiceSpec);
+    pitchShifter.prepare(voiceSpec);
+    formantShifter.prepare(voiceSpec);
+    voiceMultiplier.prepare(voiceSpec);
+    spectralEngine.prepare(voiceSpec);
+    
+    if (voiceBandFactor > 1) {
+        const int maxPathLatency = juce::jmax(pitchShifter.getLatencyInSamples(), spectralEngine.getLatencyInSamples());
+        voiceBand.prepare(sampleRate, controlBlockSize, numChannels, maxPathLatency);
+        voiceBandBlock.setSize(numChannels, voiceBand.getMaxInternalBlockSize());
+    }
+    
+    // Start from the current settings rather than gliding in from defaults
+    characterMorph.prepare(sampleRate);
+    characterMorph.reset(readUserTargets());
+    
+    distortionAmount.reset(sampleRate, 0.02);
+    distortionAmount.setCurrentAndTargetValue(readParameter(PARAM_DISTORTION));
+    lowCutFrequency.reset(sampleRate, 0.05);
+    lowCutFrequency.setCurrentAndTargetValue(readParameter(PARAM_LOW_CUT));
+    toneAmount.reset(sampleRate, 0.02);
+    toneAmount.setCurrentAndTargetValue(readParameter(PARAM_TONE));
+    chainState.reset();
+    chainControls.prepare(sampleRate);
+    interleavedScratch.setSize(numChannels, maximumBlockSize);
+    
+    // Both oversampling factors are prepared so switching never allocates
+    oversampledDistortion.prepare((int)spec.numChannels);
+    activeOversampling = getOversamplingSetting();
+    activeAntialiasing = readParameter(PARAM_DISTORTION_ANTIALIAS) >= 0.5f;
+    
+    cachedPitchSemitones = 0.0f;
+    cachedPitchRatio = 1.0f;
+    
+    // Both paths are prepared so switching modes never allocates
+    activeQualityMode = (int)readParameter(PARAM_QUALITY_MODE);
+    
+    // Set up reverb, starting at the current mix
+    const DspTargets startTargets = readUserTargets();
+    reverb.setParameters(readReverbParameters());
+    reverb.setMix(startTargets.reverb, 1.0f - startTargets.reverb * 0.5f);
+    reverb.prepare(spec);
+    
+    // Impulse responses load in the background, the current one is rebuilt for this rate
+    convolutionReverb.setMix(startTargets.reverb, 1.0f - startTargets.reverb * 0.5f);
+    convolutionReverb.prepare(spec);
+    activeReverbMode = (int)readParameter(PARAM_REVERB_MODE);
+    convolutionReverb.setActive(activeReverbMode == REVERB_CONVOLUTION);
+    
+    if (activeReverbMode == REVERB_CONVOLUTION)
+        startLoader();
+    
+    idleDetector.reset();
+    profiler.prepare(sampleRate);
+    updateLatencyAndTail();
+    
+    // Set default gain, ramped if it ever changes
+    inputGain.reset(sampleRate, 0.02);
+    outputGain.reset(sampleRate, 0.02);
+    inputGain.setCurrentAndTargetValue(0.9f);
+    outputGain.setCurrentAndTargetValue(1.0f);
+}
+
+const VocalTransformerEngine::ProfileSettings& VocalTransformerEngine::getProfileSettings(int profile)
+{
+    // PSOLA needs about 2.25 periods of the lowest pitch, which sets the floor for Live
+    static const std::array<ProfileSettings, NUM_LATENCY_PROFILES> settings {{
+        { 110.0f, -1, 4,  32, OVERSAMPLING_OFF },   // Live: ~20 ms either path at 48 kHz
+        {  80.0f,  0, 4,  64, -1 },                 // Broadcast: ~28 ms PSOLA, ~43 ms STFT
+        {  60.0f,  1, 8, 256, OVERSAMPLING_4X },    // Offline: ~38 ms PSOLA, ~85 ms STFT
+    }};
+    
+    return settings[(size_t)juce::jlimit(0, NUM_LATENCY_PROFILES - 1, profile)];
+}
+
+int VocalTransformerEngine::getOversamplingSetting() const
+{
+    const int fixedOversampling = getProfileSettings(activeProfile).oversampling;
+    return fixedOversampling >= 0 ? fixedOversampling : (int)readParameter(PARAM_DISTORTION_OVERSAMPLING);
+}
+
+int VocalTransformerEngine::getPitchPathLatency() const
+{
+    // PSOLA lookahead vs. one STFT frame
+    return activeQualityMode == HIGH_QUALITY ? spectralEngine.getLatencyInSamples()
+                                             : pitchShifter.getLatencyInSamples();
+}
+
+int VocalTransformerEngine::getTotalLatency() const
+{
+    // At the reduced rate, the path's latency is scaled up and the resampling added
+    const int pathLatency = voiceBandFactor > 1 ? voiceBand.getResamplingLatency() + voiceBandFactor * getPitchPathLatency()
+                                                : getPitchPathLatency();
+    
+    return pathLatency + oversampledDistortion.getLatencyInSamples(activeOversampling);
+}
+
+void VocalTransformerEngine::updateLatencyAndTail()
+{
+    // The air band waits for the voice band's stages
+    if (voiceBandFactor > 1)
+        voiceBand.setVoiceBandLatency(getPitchPathLatency());
+    
+    latencySamples = getTotalLatency();
+    updateTailLength();
+}
+
+void VocalTransformerEngine::updateTailLength()
+{
+    // Filters are down by 100 dB within 150 ms, even the low cut at 20 Hz
+    const int filterTail = (int)std::ceil(sampleRate * 0.15);
+    
+    const int pathTail = activeQualityMode == HIGH_QUALITY ? spectralEngine.getTailInSamples()
+                                                           : pitchShifter.getTailInSamples() + formantShifter.getTailInSamples();
+    
+    // The voice band's stages count at their own rate. The band splitter runs until
+    // the voices stop, so their tail covers its filters too.
+    const int resamplingTail = voiceBandFactor > 1 ? voiceBand.getResamplingLatency() : 0;
+    
+    idleDetector.setTailLength(IdleDetector::inputStages, filterTail);
+    idleDetector.setTailLength(IdleDetector::pitchAndFormant, voiceBandFactor * pathTail);
+    idleDetector.setTailLength(IdleDetector::voices, voiceBandFactor * voiceMultiplier.getTailInSamples() + resamplingTail);
+    idleDetector.setTailLength(IdleDetector::outputStages, filterTail + oversampledDistortion.getLatencyInSamples(activeOversampling));
+    idleDetector.setTailLength(IdleDetector::reverb, getReverbTailInSamples());
+    
+    tailLengthSeconds = sampleRate > 0.0 ? idleDetector.getTotalTailLength() / sampleRate : 0.0;
+}
+
+int VocalTransformerEngine::getReverbTailInSamples() const
+{
+    return activeReverbMode == REVERB_CONVOLUTION ? convolutionReverb.getTailInSamples()
+                                                  : reverb.getTailInSamples();
+}
+
+FdnReverb::Parameters VocalTransformerEngine::readReverbParameters() const
+{
+    FdnReverb::Parameters reverbParameters;
+    reverbParameters.roomSize = readParameter(PARAM_REVERB_ROOM_SIZE);
+    reverbParameters.damping = readParameter(PARAM_REVERB_DAMPING);
+    reverbParameters.decaySeconds = readParameter(PARAM_REVERB_DECAY);
+    return reverbParameters;
+}
+
+void VocalTransformerEngine::skipControlRamps(int numSamples)
+{
+    characterMorph.advance(numSamples);
+    inputGain.skip(numSamples);
+    outputGain.skip(numSamples);
+    distortionAmount.skip(numSamples);
+    lowCutFrequency.skip(numSamples);
+    toneAmount.skip(numSamples);
+}
+
+void VocalTransformerEngine::process(float* const* channels, int numChannelsToProcess, int numSamples)
+{
+    // Refers to the caller's channels, nothing is copied
+    juce::AudioBuffer<float> buffer(channels, juce::jmin(numChannelsToProcess, numChannels), numSamples);
+    process(buffer, buffer.getNumChannels());
+}
+
+template <typename Sample>
+void VocalTransformerEngine::processInterleavedFrames(const Sample* input, Sample* output, int numFrames)
+{
+    const int scratchChannels = interleavedScratch.getNumChannels();
+    
+    if (scratchChannels == 0)
+        return;     // not prepared
+    
+    for (int start = 0; start < numFrames; start += maximumBlockSize)
+    {
+        const int numSamples = juce::jmin(maximumBlockSize, numFrames - start);
+        const size_t offset = (size_t)start * (size_t)scratchChannels;
+        
+        InterleavedPcm::deinterleave(input + offset, interleavedScratch.getArrayOfWritePointers(), scratchChannels, numSamples);
+        process(interleavedScratch.getArrayOfWritePointers(), scratchChannels, numSamples);
+        InterleavedPcm::interleave(interleavedScratch.getArrayOfReadPointers(), output + offset, scratchChannels, numSamples);
+    }
+}
+
+void VocalTransformerEngine::processInterleaved(const juce::int16* input, juce::int16* output, int numFrames)
+{
+    processInterleavedFrames(input, output, numFrames);
+}
+
+void VocalTransformerEngine::processInterleaved(const float* input, float* output, int numFrames)
+{
+    processInterleavedFrames(input, output, numFrames);
+}
+
+void VocalTransformerEngine::process(juce::AudioBuffer<float>& buffer, int numInputChannels)
+{
+    juce::ScopedNoDenormals noDenormals;
+    const StageProfiler::ScopedBlock profiledBlock(profiler, buffer.getNumSamples());
+    StageProfiler::ScopedTimer controlsTimer(profiler, StageProfiler::controls);
+    
+    const int numSamples = buffer.getNumSamples();
+    const int numBufferChannels = buffer.getNumChannels();
+    
+    // Get parameters - ramps pick them up from here
+    distortionAmount.setTargetValue(readParameter(PARAM_DISTORTION));
+    lowCutFrequency.setTargetValue(readParameter(PARAM_LOW_CUT));
+    toneAmount.setTargetValue(readParameter(PARAM_TONE));
+    
+    // Blend the user's settings with the character preset (Normal leaves them as they are)
+    int currentCharacter = (int)readParameter(PARAM_CHARACTER);
+    float strength = readParameter(PARAM_CHARACTER_STRENGTH);
+    
+    const CharacterPreset* preset = nullptr;
+    if (currentCharacter > 0 && currentCharacter < NUM_CHARACTERS)
+        preset = &characterPresets[currentCharacter];
+    
+    characterMorph.setTargets(readUserTargets(), preset, strength);
+    
+    // Switch pitch/formant path, starting the new one from a clean state
+    int qualityMode = (int)readParameter(PARAM_QUALITY_MODE);
+    
+    if (qualityMode != activeQualityMode) {
+        activeQualityMode = qualityMode;
+        
+        if (qualityMode == HIGH_QUALITY) {
+            spectralEngine.reset();
+        } else {
+            pitchShifter.reset();
+            formantShifter.reset();
+        }
+        
+        updateLatencyAndTail();
+    }
+    
+    // Distortion settings, starting the new oversampler and antialiaser from a clean state
+    int oversampling = getOversamplingSetting();
+    bool antialiasing = readParameter(PARAM_DISTORTION_ANTIALIAS) >= 0.5f;
+    
+    if (oversampling != activeOversampling || antialiasing != activeAntialiasing) {
+        const bool latencyChanged = oversampling != activeOversampling;
+        activeOversampling = oversampling;
+        activeAntialiasing = antialiasing;
+        
+        oversampledDistortion.reset();
+        chainState.distortion.reset();
+        
+        if (latencyChanged)
+            updateLatencyAndTail();
+    }
+    
+    // Reverb settings - a new engine, decay time or impulse response changes how
+    // long the tail rings on. The engine switched to starts from silence.
+    int reverbMode = (int)readParameter(PARAM_REVERB_MODE);
+    
+    if (reverbMode != activeReverbMode) {
+        activeReverbMode = reverbMode;
+        convolutionReverb.setActive(reverbMode == REVERB_CONVOLUTION);
+        
+        if (reverbMode == REVERB_CONVOLUTION)
+            convolutionReverb.reset();
+        else
+            reverb.reset();
+    }
+    
+    reverb.setParameters(readReverbParameters());
+    
+    if (activeReverbMode == REVERB_CONVOLUTION)
+        convolutionReverb.setRoom(preset != nullptr ? preset->reverbRoom : ConvolutionReverb::room);
+    
+    if (getReverbTailInSamples() != idleDetector.getTailLength(IdleDetector::reverb))
+        updateTailLength();
+    
+    // Nothing to do once the input and every tail are silent, apart from keeping
+    // the ramps moving so nothing jumps when the input returns
+    idleDetector.process(buffer, numInputChannels);
+    
+    if (idleDetector.isIdle()) {
+        buffer.clear();
+        skipControlRamps(numSamples);
+        return;
+    }
+    
+    controlsTimer.stop();
+    
+    // Render in short slices so automation lands close to where it was written
+    for (int start = 0; start < numSamples; start += controlBlockSize) {
+        juce::AudioBuffer<float> slice(buffer.getArrayOfWritePointers(), numBufferChannels, start,
+                                       juce::jmin(controlBlockSize, numSamples - start));
+        processControlBlock(slice);
+    }
+}
+
+float VocalTransformerEngine::getPitchRatio(float semitones)
+{
+    if (semitones != cachedPitchSemitones) {
+        cachedPitchSemitones = semitones;
+        cachedPitchRatio = std::exp2(semitones / 12.0f);
+    }
+    
+    return cachedPitchRatio;
+}
+
+void VocalTransformerEngine::processControlBlock(juce::AudioBuffer<float>& block)
+{
+    StageProfiler::ScopedTimer controlsTimer(profiler, StageProfiler::controls);
+    
+    const int numSamples = block.getNumSamples();
+    const DspTargets targets = characterMorph.advance(numSamples);
+    
+    // Convert pitch shift from semitones to ratio
+    float pitchRatio = getPitchRatio(targets.pitchShift);
+    
+    // Controls for the fused stages. A stage only runs while it is
+    // ramping or set away from its neutral position.
+    const bool useLowCut = lowCutFrequency.isSmoothing() || ! ChainStages::LowCut::isBypassed(lowCutFrequency.getTargetValue());
+    const bool useTone = toneAmount.isSmoothing() || ! ChainStages::Tone::isBypassed(toneAmount.getTargetValue());
+    const bool useDistortion = distortionAmount.isSmoothing() || ! ChainStages::Distortion::isBypassed(distortionAmount.getTargetValue());
+    
+    chainControls.inputGain.fill(inputGain, numSamples);
+    chainControls.lowCut.fill(lowCutFrequency, numSamples, ChainStages::LowCut::getCoefficients);
+    chainControls.tone.fill(toneAmount, numSamples, ChainStages::Tone::getCoefficients);
+    chainControls.distortion.fill(distortionAmount, numSamples);
+    chainControls.outputGain.fill(outputGain, numSamples);
+    
+    // Stages that have gone quiet are skipped. They always come first in the chain,
+    // so clearing the slice once covers all of them.
+    if (! idleDetector.isActive(IdleDetector::inputStages))
+        block.clear();
+    
+    controlsTimer.stop();
+    
+    // 1-2. Input gain and low cut filter, fused
+    if (idleDetector.isActive(IdleDetector::inputStages)) {
+        const StageProfiler::ScopedTimer timer(profiler, StageProfiler::inputStages);
+        ChainStages::renderInputStages(chainState, block, chainControls, useLowCut);
+    }
+    
+    // 3-5 run on the voice band alone when it's split off, and it's split off for as
+    // long as any of them is active. At the reduced rate a slice can hold no voice
+    // band samples at all.
+    const bool splitVoiceBand = voiceBandFactor > 1 && idleDetector.isActive(IdleDetector::voices);
+    int numVoiceSamples = numSamples;
+    
+    if (splitVoiceBand) {
+        const StageProfiler::ScopedTimer timer(profiler, StageProfiler::pitchAndFormant);
+        numVoiceSamples = voiceBand.split(block, voiceBandBlock);
+    }
+    
+    juce::AudioBuffer<float> voiceSlice(splitVoiceBand ? voiceBandBlock.getArrayOfWritePointers() : block.getArrayOfWritePointers(),
+                                        splitVoiceBand ? voiceBandBlock.getNumChannels() : block.getNumChannels(), numVoiceSamples);
+    
+    if (idleDetector.isActive(IdleDetector::pitchAndFormant) && numVoiceSamples > 0) {
+        const StageProfiler::ScopedTimer timer(profiler, StageProfiler::pitchAndFormant);
+        
+        if (activeQualityMode == HIGH_QUALITY) {
+            // 3-4. Pitch and formant shifting on one shared STFT
+            spectralPitchShifter.setPitchRatio(pitchRatio);
+            spectralFormantShifter.setPitchRatio(pitchRatio);
+            spectralFormantShifter.setFormantShift(targets.formantShift);
+            spectralEngine.processBlock(voiceSlice);
+        } else {
+            // 3. Pitch tracking and shifting - PSOLA marks follow the tracked period
+            pitchTracker.process(voiceSlice);
+            const auto& pitchEstimate = pitchTracker.getEstimate();
+            
+            pitchShifter.setVoiced(pitchEstimate.voiced);
+            if (pitchEstimate.voiced)
+                pitchShifter.setPitchPeriod(pitchEstimate.period);
+            
+            pitchShifter.setPitchRatio(pitchRatio);
+            pitchShifter.processBlock(voiceSlice);
+            
+            // 4. Formant shifting
+            formantShifter.setFormantShift(targets.formantShift);
+            formantShifter.processBlock(voiceSlice);
+        }
+    }
+    
+    // 5. Voice multiplication
+    if (idleDetector.isActive(IdleDetector::voices) && numVoiceSamples > 0) {
+        const StageProfiler::ScopedTimer timer(profiler, StageProfiler::voices);
+        voiceMultiplier.setVoiceCount(juce::roundToInt(targets.voiceCount));
+        voiceMultiplier.setDetune(targets.detune);
+        voiceMultiplier.processBlock(voiceSlice);
+    }
+    
+    if (splitVoiceBand) {
+        const StageProfiler::ScopedTimer timer(profiler, StageProfiler::voices);
+        voiceBand.combine(voiceBandBlock, numVoiceSamples, block);
+    }
+    
+    // 6-7. Tone control, distortion and output gain, fused unless the distortion is oversampled
+    if (idleDetector.isActive(IdleDetector::outputStages)) {
+        const StageProfiler::ScopedTimer timer(profiler, StageProfiler::outputStages);
+        
+        auto distortionMode = ChainStages::DistortionMode::off;
+        if (useDistortion)
+            distortionMode = activeAntialiasing ? ChainStages::DistortionMode::antialiased
+                                                : ChainStages::DistortionMode::plain;
+        
+        if (activeOversampling == OVERSAMPLING_OFF)
+            ChainStages::renderOutputStages(chainState, block, chainControls, useTone, distortionMode);
+        else
+            ChainStages::renderOversampledOutputStages(chainState, block, chainControls, oversampledDistortion,
+                                                       useTone, distortionMode, activeOversampling);
+    }
+    
+    // 8. Apply reverb - both engines ramp their own wet/dry gains. It is never idle
+    // here, process() returns early once it is.
+    const float reverbDry = 1.0f - (targets.reverb * 0.5f); // Ensure dry signal remains audible
+    const StageProfiler::ScopedTimer reverbTimer(profiler, StageProfiler::reverb);
+    
+    if (activeReverbMode == REVERB_CONVOLUTION) {
+        convolutionReverb.setMix(targets.reverb, reverbDry);
+        convolutionReverb.process(block);
+    } else {
+        reverb.setMix(targets.reverb, reverbDry);
+        reverb.process(block);
+    }
+}
+
+void VocalTransformerEngine::loadImpulseResponse(const juce::File& file)
+{
+    convolutionReverb.loadFile(file);
+}
+
+juce::File VocalTransformerEngine::getImpulseResponseFile() const
+{
+    return convolutionReverb.getFile();
+}
+
+bool VocalTransformerEngine::isLoaderNeeded() const
+{
+    return (int)readParameter(PARAM_REVERB_MODE) == REVERB_CONVOLUTION && convolutionReverb.needsWaking();
+}
+
+void VocalTransformerEngine::startLoader()
+{
+    // The character's room is asked for up front, so the loader starts on the right one
+    const int character = (int)readParameter(PARAM_CHARACTER);
+    convolutionReverb.setRoom(character > 0 && character < NUM_CHARACTERS ? characterPresets[character].reverbRoom
+                                                                          : ConvolutionReverb::room);
+    convolutionReverb.startLoading();
+}
+
+bool VocalTransformerEngine::waitUntilReady(int timeoutMilliseconds)
+{
+    // Only the convolution reverb loads anything. It may have been selected since
+    // prepare(), in which case its loader starts here.
+    if ((int)readParameter(PARAM_REVERB_MODE) != REVERB_CONVOLUTION)
+        return true;
+    
+    startLoader();
+    
+    const bool ready = convolutionReverb.waitUntilReady(timeoutMilliseconds);
+    updateTailLength();
+    return ready;
+}
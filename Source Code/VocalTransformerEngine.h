@@ -0,0 +1,1077 @@
+#pragma once
+
+// All of the transformer's DSP, without the plugin around it: no AudioProcessor,
+// parameter tree or editor, only juce_core, juce_audio_basics, juce_audio_formats
+// (for impulse response files) and juce_dsp. The plugin is a thin wrapper over it,
+// and VocalTransformerApi.h puts a plain C interface in front of it for servers and
+// benchmarks that shouldn't pay for a plugin host.
+//
+// Audio is processed in place in the caller's channel pointers, with no copies.
+// Parameters are in the same plain units as the plugin's (semitones, Hz, seconds,
+// choice indices) and can be set from any thread; the audio thread picks them up at
+// its next block.
+
+#include <JuceHeader.h>
+#include "ChainStages.h"
+#include "ConvolutionReverb.h"
+#include "FdnReverb.h"
+#include "InterleavedPcm.h"
+#include "IdleDetector.h"
+#include "PitchTracker.h"
+#include "SpectralStages.h"
+#include "StageProfiler.h"
+#include "VoiceBandSplitter.h"
+
+// Define the character presets
+enum CharacterType {
+    NORMAL = 0,
+    ROBOT,
+    ALIEN,
+    CHILD,
+    GIANT,
+    ELDER,
+    CHOIR,
+    NUM_CHARACTERS
+};
+
+// Processing paths for pitch and formant shifting
+enum QualityMode {
+    LOW_LATENCY = 0,    // time-domain PSOLA + LPC
+    HIGH_QUALITY,       // shared STFT phase vocoder
+    NUM_QUALITY_MODES
+};
+
+// Oversampling for the distortion stage (the index is the oversampling order)
+enum DistortionOversampling {
+    OVERSAMPLING_OFF = 0,
+    OVERSAMPLING_2X,
+    OVERSAMPLING_4X,
+    NUM_OVERSAMPLING_FACTORS
+};
+
+// Latency budgets, from the shortest delay to the best quality
+enum LatencyProfile {
+    PROFILE_LIVE = 0,       // shortest windows, no oversampling
+    PROFILE_BROADCAST,      // the standard windows
+    PROFILE_OFFLINE,        // longest windows and most overlap, 4x oversampling
+    NUM_LATENCY_PROFILES
+};
+
+// Reverb engines
+enum ReverbMode {
+    REVERB_ALGORITHMIC = 0,     // feedback delay network
+    REVERB_CONVOLUTION,         // impulse response, built-in or from a file
+    NUM_REVERB_MODES
+};
+
+// Everything the engine can be set to. The plugin's parameter IDs are in brackets.
+enum EngineParameter {
+    PARAM_CHARACTER = 0,                // CharacterType ("character")
+    PARAM_CHARACTER_STRENGTH,           // 0 to 1 ("character_strength")
+    PARAM_PITCH_SHIFT,                  // semitones, -12 to 12 ("pitch_shift")
+    PARAM_FORMANT_SHIFT,                // 0 = low, 0.5 = neutral, 1 = high ("formant_shift")
+    PARAM_VOICE_COUNT,                  // 1 to 64 ("voice_count")
+    PARAM_DETUNE,                       // 0 to 1 ("detune")
+    PARAM_REVERB,                       // wet amount, 0 to 1 ("reverb")
+    PARAM_REVERB_ROOM_SIZE,             // 0 to 1 ("reverb_room_size")
+    PARAM_REVERB_DAMPING,               // 0 to 1 ("reverb_damping")
+    PARAM_REVERB_DECAY,                 // seconds, 0.2 to 10 ("reverb_decay")
+    PARAM_REVERB_MODE,                  // ReverbMode ("reverb_mode")
+    PARAM_DISTORTION,                   // 0 to 1 ("distortion")
+    PARAM_LOW_CUT,                      // Hz, 20 to 1000 ("low_cut")
+    PARAM_TONE,                         // 0 = dark, 0.5 = flat, 1 = bright ("tone")
+    PARAM_QUALITY_MODE,                 // QualityMode ("quality_mode")
+    PARAM_DISTORTION_OVERSAMPLING,      // DistortionOversampling ("distortion_oversampling")
+    PARAM_DISTORTION_ANTIALIAS,         // 0 or 1 ("distortion_antialias")
+    PARAM_LATENCY_PROFILE,              // LatencyProfile, needs prepare() ("latency_profile")
+    PARAM_REDUCED_RATE,                 // 0 or 1, needs prepare() ("reduced_rate")
+    NUM_PARAMETERS
+};
+
+//==============================================================================
+class VocalTransformerEngine {
+public:
+    struct ParameterInfo {
+        const char* id;             // as in the plugin's parameter tree and saved state
+        float minimum;
+        float maximum;
+        float defaultValue;
+    };
+    
+    static const ParameterInfo& getParameterInfo(EngineParameter parameter);
+    
+    VocalTransformerEngine();
+    
+    // Allocates everything processing needs, so process() never does. Not called
+    // while audio is running.
+    void prepare(double newSampleRate, int newMaximumBlockSize, int newNumChannels);
+    
+    // Processes in place, at most the prepared block size. Channels beyond the
+    // prepared count are left alone. The buffer form is for hosts whose extra output
+    // channels carry no input: only the first numInputChannels count as input.
+    void process(float* const* channels, int numChannels, int numSamples);
+    void process(juce::AudioBuffer<float>& buffer, int numInputChannels);
+    
+    // Interleaved frames with the prepared channel count, e.g. 20 ms of int16 PCM
+    // straight from a telephony stack. Converted into a scratch block set aside in
+    // prepare() and back out, with no other copies. Frames of any length work, with
+    // no added latency: longer ones go through in pieces of the prepared block size.
+    // Input and output may be the same array.
+    void processInterleaved(const juce::int16* input, juce::int16* output, int numFrames);
+    void processInterleaved(const float* input, float* output, int numFrames);
+    
+    // Any thread. Values are clamped to the parameter's range.
+    void setParameter(EngineParameter parameter, float value);
+    float getParameter(EngineParameter parameter) const;
+    
+    // Reads the parameter from somewhere else from now on, such as a plugin's
+    // parameter tree, so nothing is copied per block. Before prepare().
+    void bindParameter(EngineParameter parameter, std::atomic<float>* source);
+    
+    // The latency profile or reduced rate setting has changed since prepare(), which
+    // only takes effect when prepare() is called again
+    bool isPrepareNeeded() const;
+    
+    // Any thread. Both follow the active settings and can change in process().
+    int getLatencySamples() const { return latencySamples.load(); }
+    double getTailLengthSeconds() const { return tailLengthSeconds.load(); }
+    
+    // Impulse response for the convolution reverb, loaded in the background. An
+    // empty file goes back to the built-in room of the selected character.
+    void loadImpulseResponse(const juce::File& file);
+    juce::File getImpulseResponseFile() const;
+    
+    // The loader thread only runs once the convolution reverb has been selected, and
+    // only polls for the audio thread's room changes while it's in use. prepare() and
+    // waitUntilReady() start it. After a switch in process(), isLoaderNeeded() turns
+    // true and startLoader() is due, off the audio thread.
+    bool isLoaderNeeded() const;
+    void startLoader();
+    
+    // Offline rendering: waits for background work such as building the impulse
+    // response, so the first block already sounds right. Call after prepare(),
+    // never while audio is running.
+    bool waitUntilReady(int timeoutMilliseconds);
+    
+    // Per-stage timing of process(), off until enabled. Safe to poll from any thread.
+    StageProfiler& getProfiler() { return profiler; }
+    
+private:
+    // Blocks are rendered in slices of this many samples. Control values are
+    // updated once per slice, and the ramps below run per sample inside it.
+    static constexpr int controlBlockSize = 32;
+    
+    // Gains and additional effect values, ramped per sample
+    juce::SmoothedValue<float> inputGain;
+    juce::SmoothedValue<float> outputGain;
+    juce::SmoothedValue<float> distortionAmount;
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> lowCutFrequency;
+    juce::SmoothedValue<float> toneAmount;
+    
+    // Per-sample stages (see ChainStages.h) and their controls for the current slice
+    ChainStages::State chainState;
+    ChainStages::Controls<controlBlockSize> chainControls;
+    
+    // Distortion oversampling and antialiasing, switched at block boundaries
+    ChainStages::OversampledDistortion<controlBlockSize> oversampledDistortion;
+    int activeOversampling = OVERSAMPLING_OFF;
+    bool activeAntialiasing = true;
+    
+    // Semitones to ratio, recomputed only when the smoothed value has moved
+    float cachedPitchSemitones = 0.0f;
+    float cachedPitchRatio = 1.0f;
+    float getPitchRatio(float semitones);
+    
+    double sampleRate = 0.0;
+    int maximumBlockSize = 0;
+    int numChannels = 0;
+    
+    // Planar home for interleaved frames while they're processed
+    juce::AudioBuffer<float> interleavedScratch;
+    
+    template <typename Sample>
+    void processInterleavedFrames(const Sample* input, Sample* output, int numFrames);
+    
+    // Runs the whole chain on one slice
+    void processControlBlock(juce::AudioBuffer<float>& block);
+    
+public:
+    // The low latency path's stages. Public so the benchmarks can time them on their own.
+    
+    // Time-domain PSOLA pitch shifter.
+    // Pitch marks are placed one period apart on the mono mix, snapped to the local
+    // waveform peak. Two-period Hann grains centred on those marks are overlap-added
+    // at a spacing of period / pitchRatio. All buffers are sized in prepare(), so the
+    // audio thread never allocates, and each output sample costs at most
+    // 2 * pitchRatio windowed multiply-adds per channel.
+    class SimpleShifter {
+    public:
+        // Lowest pitch that gets its own marks. The window, and with it the latency,
+        // is about 2.25 periods of it. Call before prepare().
+        void setLowestPitch(float frequency) {
+            minFrequency = juce::jlimit(40.0f, 200.0f, frequency);
+        }
+        
+        void prepare(const juce::dsp::ProcessSpec& spec) {
+            sampleRate = (float) spec.sampleRate;
+            numChannels = (int) spec.numChannels;
+            
+            minPeriod = juce::jmax(2, (int) (sampleRate / maxFrequency));
+            maxPeriod = juce::jmax(minPeriod + 1, (int) std::ceil(sampleRate / minFrequency));
+            
+            // A mark is only final once 1.25 periods of input have arrived after it,
+            // and a grain needs one more period on each side of its synthesis mark
+            lookahead = (maxPeriod * 5 + 3) / 4;
+            latency = lookahead + maxPeriod;
+            
+            // Oldest sample a grain can read is roughly lookahead + synthesis spacing
+            // (up to 2 periods) + mark spacing + grain half-length behind the write head
+            const int ringSize = juce::nextPowerOfTwo(8 * maxPeriod + 8);
+            ringMask = ringSize - 1;
+            
+            inputRing.assign((size_t) numChannels, std::vector<float>((size_t) ringSize, 0.0f));
+            outputRing.assign((size_t) numChannels, std::vector<float>((size_t) ringSize, 0.0f));
+            analysisRing.assign((size_t) ringSize, 0.0f);
+            grainWindow.assign((size_t) (2 * maxPeriod + 1), 0.0f);
+            
+            setPitchPeriod(sampleRate / 150.0f);
+            reset();
+        }
+        
+        void reset() {
+            for (auto& ring : inputRing)
+                std::fill(ring.begin(), ring.end(), 0.0f);
+            for (auto& ring : outputRing)
+                std::fill(ring.begin(), ring.end(), 0.0f);
+            std::fill(analysisRing.begin(), analysisRing.end(), 0.0f);
+            
+            inputTime = 0;
+            pitchMarks[0] = 0;
+            numPitchMarks = 1;
+            markCursor = 0;
+            nextSearchEnd = (pitchPeriod * 5) / 4;
+            nextSynthesisMark = 0.0;
+            windowPeriod = 0;
+        }
+        
+        void setPitchRatio(float newRatio) {
+            pitchRatio = juce::jlimit(0.5f, 2.0f, newRatio);
+        }
+        
+        // Expected analysis period in samples; marks are searched for around it
+        void setPitchPeriod(float newPeriodSamples) {
+            pitchPeriod = juce::jlimit(minPeriod, maxPeriod, juce::roundToInt(newPeriodSamples));
+        }
+        
+        // Unvoiced input has no peaks worth following, so marks are just spaced evenly
+        void setVoiced(bool isVoiced) {
+            voiced = isVoiced;
+        }
+        
+        int getLatencyInSamples() const {
+            return latency;
+        }
+        
+        // Latency plus the last grain, which spans two periods
+        int getTailInSamples() const {
+            return latency + 2 * maxPeriod;
+        }
+        
+        void processBlock(juce::AudioBuffer<float>& buffer) {
+            const int numSamples = buffer.getNumSamples();
+            const int channels = juce::jmin(buffer.getNumChannels(), numChannels);
+            
+            if (channels <= 0)
+                return;
+            
+            auto* const* channelData = buffer.getArrayOfWritePointers();
+            const float monoScale = 1.0f / (float) channels;
+            
+            for (int sample = 0; sample < numSamples; ++sample) {
+                const int writeIndex = (int) (inputTime & ringMask);
+                float mono = 0.0f;
+                
+                for (int channel = 0; channel < channels; ++channel) {
+                    inputRing[(size_t) channel][(size_t) writeIndex] = channelData[channel][sample];
+                    mono += channelData[channel][sample];
+                }
+                
+                analysisRing[(size_t) writeIndex] = mono * monoScale;
+                
+                if (inputTime >= nextSearchEnd)
+                    placeNextPitchMark();
+                
+                while (nextSynthesisMark <= (double) (inputTime - lookahead))
+                    addSynthesisGrain(channels);
+                
+                // Grains overlapping this position have all been added by now
+                const int readIndex = (int) ((inputTime - latency) & ringMask);
+                
+                for (int channel = 0; channel < channels; ++channel) {
+                    auto& ring = outputRing[(size_t) channel];
+                    channelData[channel][sample] = ring[(size_t) readIndex];
+                    ring[(size_t) readIndex] = 0.0f;
+                }
+                
+                ++inputTime;
+            }
+        }
+        
+    private:
+        static constexpr float maxFrequency = 1000.0f;
+        static constexpr int markCapacity = 64; // power of two
+        
+        float minFrequency = 80.0f;
+        
+        void placeNextPitchMark() {
+            const int64_t lastMark = pitchMarks[(size_t) ((numPitchMarks - 1) & (markCapacity - 1))];
+            const int64_t searchStart = lastMark + (pitchPeriod * 3) / 4;
+            const int64_t searchEnd = lastMark + (pitchPeriod * 5) / 4;
+            
+            int64_t bestMark = lastMark + pitchPeriod;
+            
+            if (voiced) {
+                bestMark = searchStart;
+                float bestValue = analysisRing[(size_t) (searchStart & ringMask)];
+                
+                for (int64_t n = searchStart + 1; n <= searchEnd; ++n) {
+                    const float value = analysisRing[(size_t) (n & ringMask)];
+                    bestMark = value > bestValue ? n : bestMark;
+                    bestValue = juce::jmax(value, bestValue);
+                }
+            }
+            
+            pitchMarks[(size_t) (numPitchMarks & (markCapacity - 1))] = bestMark;
+            ++numPitchMarks;
+            nextSearchEnd = bestMark + (pitchPeriod * 5) / 4;
+        }
+        
+        void addSynthesisGrain(int channels) {
+            const int64_t synthesisMark = (int64_t) std::llround(nextSynthesisMark);
+            
+            // Analysis mark at or just before the synthesis mark; the one after it is
+            // always known because marks are found lookahead samples ahead of synthesis
+            while (markCursor + 1 < numPitchMarks
+                   && pitchMarks[(size_t) ((markCursor + 1) & (markCapacity - 1))] <= synthesisMark)
+                ++markCursor;
+            
+            jassert(numPitchMarks - markCursor < markCapacity);
+            
+            const int64_t analysisMark = pitchMarks[(size_t) (markCursor & (markCapacity - 1))];
+            int localPeriod = pitchPeriod;
+            
+            if (markCursor + 1 < numPitchMarks)
+                localPeriod = (int) (pitchMarks[(size_t) ((markCursor + 1) & (markCapacity - 1))] - analysisMark);
+            
+            localPeriod = juce::jlimit(minPeriod, maxPeriod, localPeriod);
+            updateGrainWindow(localPeriod);
+            
+            const int grainLength = 2 * localPeriod + 1;
+            const int64_t readStart = analysisMark - localPeriod;
+            const int64_t writeStart = synthesisMark - localPeriod;
+            
+            for (int channel = 0; channel < channels; ++channel) {
+                const float* input = inputRing[(size_t) channel].data();
+                float* output = outputRing[(size_t) channel].data();
+                
+                for (int k = 0; k < grainLength; ++k)
+                    output[(writeStart + k) & ringMask] += grainWindow[(size_t) k] * input[(readStart + k) & ringMask];
+            }
+            
+            nextSynthesisMark += (double) localPeriod / (double) pitchRatio;
+        }
+        
+        // Hann window spanning two periods, so grains one period apart sum to unity.
+        // Built with a rotating phasor: two trig calls per period change, none per sample.
+        void updateGrainWindow(int period) {
+            if (period == windowPeriod)
+                return;
+            
+            const double delta = juce::MathConstants<double>::pi / (double) period;
+            const double cosDelta = std::cos(delta);
+            const double sinDelta = std::sin(delta);
+            double c = 1.0, s = 0.0;
+            
+            for (int k = 0; k <= 2 * period; ++k) {
+                grainWindow[(size_t) k] = (float) (0.5 - 0.5 * c);
+                const double nextC = c * cosDelta - s * sinDelta;
+                s = s * cosDelta + c * sinDelta;
+                c = nextC;
+            }
+            
+            windowPeriod = period;
+        }
+        
+        float sampleRate = 44100.0f;
+        int numChannels = 0;
+        float pitchRatio = 1.0f;
+        bool voiced = true;
+        
+        int minPeriod = 44;
+        int maxPeriod = 552;
+        int pitchPeriod = 294;
+        int lookahead = 0;
+        int latency = 0;
+        int ringMask = 0;
+        
+        std::vector<std::vector<float>> inputRing;
+        std::vector<std::vector<float>> outputRing;
+        std::vector<float> analysisRing;
+        std::vector<float> grainWindow;
+        int windowPeriod = 0;
+        
+        std::array<int64_t, markCapacity> pitchMarks {};
+        int64_t numPitchMarks = 0;
+        int64_t markCursor = 0;
+        int64_t inputTime = 0;
+        int64_t nextSearchEnd = 0;
+        double nextSynthesisMark = 0.0;
+    };
+    
+    // LPC formant shifter.
+    // Every hop, the spectral envelope of the mono mix is estimated by LPC
+    // (autocorrelation + Levinson-Durbin). The envelope is estimated twice: once from
+    // the last frame as-is, and once from the same frame read formantRatio times
+    // faster, which stretches its envelope by formantRatio. Each channel is whitened
+    // with the first predictor and re-coloured with the second. Coefficients only change
+    // at hop boundaries, and the per-sample kernel is two branch-free dot products.
+    class SimpleFormantShifter {
+    public:
+        void prepare(const juce::dsp::ProcessSpec& spec) {
+            sampleRate = spec.sampleRate;
+            numChannels = (int) spec.numChannels;
+            
+            frameSize = juce::nextPowerOfTwo((int) (sampleRate * 0.01));
+            hopSize = frameSize / 4;
+            order = juce::jlimit(12, maxOrder, (int) (sampleRate / 3000.0));
+            
+            // History must cover a frame read at the fastest warp
+            const int ringSize = juce::nextPowerOfTwo((int) (frameSize * maxFormantRatio) + 4);
+            ringMask = ringSize - 1;
+            analysisRing.assign((size_t) ringSize, 0.0f);
+            frame.assign((size_t) frameSize, 0.0f);
+            
+            analysisWindow.resize((size_t) frameSize);
+            for (int n = 0; n < frameSize; ++n)
+                analysisWindow[(size_t) n] = 0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * (float) n / (float) (frameSize - 1));
+            
+            // Gaussian lag window (about 80 Hz) keeps Levinson away from pitch harmonics
+            for (int k = 0; k <= maxOrder; ++k) {
+                const double x = juce::MathConstants<double>::twoPi * 80.0 * k / sampleRate;
+                lagWindow[(size_t) k] = std::exp(-0.5 * x * x);
+            }
+            
+            channelStates.resize((size_t) numChannels);
+            for (auto& state : channelStates) {
+                state.inputHistory.assign((size_t) (2 * order), 0.0f);
+                state.outputHistory.assign((size_t) (2 * order), 0.0f);
+            }
+            
+            reset();
+        }
+        
+        void reset() {
+            std::fill(analysisRing.begin(), analysisRing.end(), 0.0f);
+            
+            for (auto& state : channelStates) {
+                std::fill(state.inputHistory.begin(), state.inputHistory.end(), 0.0f);
+                std::fill(state.outputHistory.begin(), state.outputHistory.end(), 0.0f);
+                state.historyPos = 0;
+            }
+            
+            whitening.fill(0.0f);
+            colouring.fill(0.0f);
+            gain = targetGain = 1.0f;
+            writePos = 0;
+            samplesUntilHop = hopSize;
+            wasBypassed = true;
+        }
+        
+        // No latency; the re-colouring filter rings for well under a frame
+        int getTailInSamples() const {
+            return frameSize;
+        }
+        
+        // 0 = low, 0.5 = neutral, 1 = high; the envelope moves by up to half an octave each way
+        void setFormantShift(float newShift) {
+            formantShift = juce::jlimit(0.0f, 1.0f, newShift);
+            formantRatio = std::pow(2.0f, formantShift - 0.5f);
+        }
+        
+        void processBlock(juce::AudioBuffer<float>& buffer) {
+            const int numSamples = buffer.getNumSamples();
+            const int channels = juce::jmin(buffer.getNumChannels(), numChannels);
+            
+            if (channels <= 0)
+                return;
+            
+            const bool bypassed = std::abs(formantRatio - 1.0f) < 0.005f;
+            
+            // Coming out of bypass the output equalled the input, so the
+            // synthesis filter can pick up the input history as its own
+            if (wasBypassed && ! bypassed)
+                for (auto& state : channelStates)
+                    state.outputHistory = state.inputHistory;
+            
+            wasBypassed = bypassed;
+            
+            int start = 0;
+            while (start < numSamples) {
+                const int segment = juce::jmin(numSamples - start, samplesUntilHop);
+                
+                pushAnalysisSamples(buffer, channels, start, segment);
+                
+                float segmentEndGain = gain;
+                
+                for (int channel = 0; channel < channels; ++channel) {
+                    auto& state = channelStates[(size_t) channel];
+                    float* data = buffer.getWritePointer(channel, start);
+                    
+                    if (bypassed)
+                        pushHistoryOnly(data, segment, state);
+                    else
+                        segmentEndGain = filterSegment(data, segment, state);
+                }
+                
+                gain = segmentEndGain;
+                
+                start += segment;
+                samplesUntilHop -= segment;
+                
+                if (samplesUntilHop == 0) {
+                    samplesUntilHop = hopSize;
+                    if (! bypassed)
+                        updateCoefficients();
+                }
+            }
+        }
+        
+    private:
+        static constexpr int maxOrder = 32;
+        static constexpr float maxFormantRatio = 1.42f;
+        
+        struct ChannelState {
+            // Both stored newest-first and mirrored, so history[pos + k] is the sample k + 1 steps back
+            std::vector<float> inputHistory;
+            std::vector<float> outputHistory;
+            int historyPos = 0;
+        };
+        
+        void pushAnalysisSamples(const juce::AudioBuffer<float>& buffer, int channels, int start, int count) {
+            const float monoScale = 1.0f / (float) channels;
+            
+            for (int i = 0; i < count; ++i) {
+                float mono = 0.0f;
+                for (int channel = 0; channel < channels; ++channel)
+                    mono += buffer.getReadPointer(channel)[start + i];
+                
+                analysisRing[(size_t) writePos] = mono * monoScale;
+                writePos = (writePos + 1) & ringMask;
+            }
+        }
+        
+        void pushHistoryOnly(const float* data, int count, ChannelState& state) {
+            for (int i = 0; i < count; ++i) {
+                state.historyPos = state.historyPos == 0 ? order - 1 : state.historyPos - 1;
+                state.inputHistory[(size_t) state.historyPos] = data[i];
+                state.inputHistory[(size_t) (state.historyPos + order)] = data[i];
+            }
+        }
+        
+        // Returns the smoothed gain reached at the end of the segment
+        float filterSegment(float* data, int count, ChannelState& state) {
+            const int p = order;
+            float g = gain;
+            const float* a = whitening.data();
+            const float* b = colouring.data();
+            
+            for (int i = 0; i < count; ++i) {
+                const float x = data[i];
+                const float* xHistory = state.inputHistory.data() + state.historyPos;
+                const float* yHistory = state.outputHistory.data() + state.historyPos;
+                
+                float residual = x;
+                for (int k = 0; k < p; ++k)
+                    residual += a[k] * xHistory[k];
+                
+                float y = g * residual;
+                for (int k = 0; k < p; ++k)
+                    y -= b[k] * yHistory[k];
+                
+                g += 0.002f * (targetGain - g);
+                
+                state.historyPos = state.historyPos == 0 ? p - 1 : state.historyPos - 1;
+                state.inputHistory[(size_t) state.historyPos] = x;
+                state.inputHistory[(size_t) (state.historyPos + p)] = x;
+                state.outputHistory[(size_t) state.historyPos] = y;
+                state.outputHistory[(size_t) (state.historyPos + p)] = y;
+                
+                data[i] = y;
+            }
+            
+            return g;
+        }
+        
+        void updateCoefficients() {
+            // Frame as recorded
+            for (int n = 0; n < frameSize; ++n)
+                frame[(size_t) n] = analysisWindow[(size_t) n] * analysisRing[(size_t) ((writePos - frameSize + n) & ringMask)];
+            
+            double originalError = 0.0;
+            if (! estimateEnvelope(whitening, originalError))
+                return;
+            
+            // Same frame ending now, read formantRatio samples per step
+            for (int n = 0; n < frameSize; ++n) {
+                const float position = (float) (frameSize - 1 - n) * formantRatio;
+                const int whole = (int) position;
+                const float fraction = position - (float) whole;
+                const float newer = analysisRing[(size_t) ((writePos - 1 - whole) & ringMask)];
+                const float older = analysisRing[(size_t) ((writePos - 2 - whole) & ringMask)];
+                frame[(size_t) n] = analysisWindow[(size_t) n] * (newer + fraction * (older - newer));
+            }
+            
+            double warpedError = 0.0;
+            if (! estimateEnvelope(colouring, warpedError)) {
+                colouring = whitening;
+                warpedError = originalError;
+            }
+            
+            // Keep loudness: output power ~ residual power / normalised error of the new envelope
+            targetGain = juce::jlimit(0.25f, 4.0f, (float) std::sqrt(warpedError / originalError));
+        }
+        
+        // LPC of the current frame; returns false for silence. The coefficients are
+        // stored without the leading 1 and with 0.994^k bandwidth expansion.
+        bool estimateEnvelope(std::array<float, maxOrder>& coefficients, double& normalisedError) {
+            std::array<double, maxOrder + 1> r {};
+            
+            for (int lag = 0; lag <= order; ++lag) {
+                double sum = 0.0;
+                for (int n = lag; n < frameSize; ++n)
+                    sum += (double) frame[(size_t) n] * frame[(size_t) (n - lag)];
+                r[(size_t) lag] = sum * lagWindow[(size_t) lag];
+            }
+            
+            if (r[0] < 1.0e-9)
+                return false;
+            
+            r[0] *= 1.0001; // white-noise correction
+            
+            std::array<double, maxOrder + 1> lpc {};
+            std::array<double, maxOrder + 1> previous {};
+            lpc[0] = 1.0;
+            double error = r[0];
+            
+            for (int i = 1; i <= order; ++i) {
+                double acc = r[(size_t) i];
+                for (int j = 1; j < i; ++j)
+                    acc += lpc[(size_t) j] * r[(size_t) (i - j)];
+                
+                const double reflection = -acc / error;
+                previous = lpc;
+                
+                for (int j = 1; j < i; ++j)
+                    lpc[(size_t) j] = previous[(size_t) j] + reflection * previous[(size_t) (i - j)];
+                
+                lpc[(size_t) i] = reflection;
+                error *= 1.0 - reflection * reflection;
+            }
+            
+            double expansion = 1.0;
+            for (int k = 0; k < order; ++k) {
+                expansion *= 0.994;
+                coefficients[(size_t) k] = (float) (lpc[(size_t) (k + 1)] * expansion);
+            }
+            
+            normalisedError = juce::jmax(error / r[0], 1.0e-6);
+            return true;
+        }
+        
+        double sampleRate = 44100.0;
+        int numChannels = 0;
+        float formantShift = 0.5f; // 0 = low, 0.5 = neutral, 1.0 = high
+        float formantRatio = 1.0f;
+        
+        int frameSize = 512;
+        int hopSize = 128;
+        int order = 16;
+        
+        std::vector<float> analysisRing;
+        std::vector<float> frame;
+        std::vector<float> analysisWindow;
+        std::array<double, maxOrder + 1> lagWindow {};
+        int ringMask = 0;
+        int writePos = 0;
+        int samplesUntilHop = 0;
+        bool wasBypassed = true;
+        
+        std::array<float, maxOrder> whitening {};
+        std::array<float, maxOrder> colouring {};
+        float gain = 1.0f;
+        float targetGain = 1.0f;
+        
+        std::vector<ChannelState> channelStates;
+    };
+    
+    // Unison / choir voice multiplier, 1 to 64 voices.
+    // Each channel has its own power-of-two history ring, indexed with a bitmask.
+    // Every extra voice reads its channel's ring at its own fractional delay (its
+    // time offset). The delay drifts on a slow per-voice LFO, which detunes the
+    // voice, and the voice gets its own constant-power stereo pan.
+    // Voice state is structure-of-arrays, processed in batches of voiceBatchSize
+    // lanes with per-lane accumulators. Each batch is a straight-line loop the compiler
+    // maps onto one SIMD register, and unused lanes carry zero gain instead of branching.
+    class SimpleVoiceMultiplier {
+    public:
+        static constexpr int maxVoices = 64;
+        static constexpr int voiceBatchSize = 8;
+        
+        void prepare(const juce::dsp::ProcessSpec& spec) {
+            sampleRate = (float) spec.sampleRate;
+            numChannels = (int) spec.numChannels;
+            maxBlockSize = juce::jmax(1, (int) spec.maximumBlockSize);
+            
+            const int ringSize = juce::nextPowerOfTwo((int) (sampleRate * maxDelaySeconds) + maxBlockSize + 2);
+            ringMask = ringSize - 1;
+            rings.assign((size_t) numChannels, std::vector<float>((size_t) ringSize, 0.0f));
+            
+            // Golden-ratio spread gives every ensemble size evenly scattered time offsets
+            // (10-42 ms), pan positions and unrelated slow LFO rates
+            for (int v = 0; v < maxVoices; ++v) {
+                const float spread = std::fmod(0.618034f * (float) v, 1.0f);
+                const float panSpread = std::fmod(0.618034f * (float) v + 0.5f, 1.0f);
+                const float panAngle = juce::MathConstants<float>::halfPi * (0.15f + 0.7f * panSpread);
+                
+                baseDelay[(size_t) v] = sampleRate * (0.010f + 0.032f * spread);
+                lfoIncrement[(size_t) v] = juce::MathConstants<float>::twoPi * (0.19f + 0.37f * panSpread) / sampleRate;
+                panLeft[(size_t) v] = std::cos(panAngle);
+                panRight[(size_t) v] = std::sin(panAngle);
+            }
+            
+            reset();
+        }
+        
+        void reset() {
+            for (auto& ring : rings)
+                std::fill(ring.begin(), ring.end(), 0.0f);
+            writePos = 0;
+            
+            for (int v = 0; v < maxVoices; ++v)
+                lfoPhase[(size_t) v] = 2.1f * (float) v;
+        }
+        
+        // The longest delay a voice can read from
+        int getTailInSamples() const {
+            return (int) std::ceil(sampleRate * maxDelaySeconds);
+        }
+        
+        void setVoiceCount(int newCount) {
+            voiceCount = juce::jlimit(1, maxVoices, newCount);
+        }
+        
+        // 0..1, up to 4 ms of delay swing per voice (roughly +-10 cents)
+        void setDetune(float newDetune) {
+            detune = juce::jlimit(0.0f, 1.0f, newDetune);
+        }
+        
+        void processBlock(juce::AudioBuffer<float>& audioBuffer) {
+            const int numSamples = audioBuffer.getNumSamples();
+            const int channels = juce::jmin(audioBuffer.getNumChannels(), numChannels);
+            
+            // Chunks never exceed the prepared block size, which the rings are sized for
+            for (int start = 0; start < numSamples; start += maxBlockSize) {
+                const int chunk = juce::jmin(maxBlockSize, numSamples - start);
+                
+                // The history always stays current, so voices fade in cleanly
+                for (int channel = 0; channel < channels; ++channel) {
+                    const float* channelData = audioBuffer.getReadPointer(channel, start);
+                    float* ring = rings[(size_t) channel].data();
+                    
+                    for (int i = 0; i < chunk; ++i)
+                        ring[(writePos + i) & ringMask] = channelData[i];
+                }
+                
+                const int extraVoices = voiceCount - 1;
+                
+                if (extraVoices > 0) {
+                    updateVoices(chunk, extraVoices, channels);
+                    const int numLanes = ((extraVoices + voiceBatchSize - 1) / voiceBatchSize) * voiceBatchSize;
+                    
+                    if (channels >= 2)
+                        renderStereo(audioBuffer.getWritePointer(0, start), audioBuffer.getWritePointer(1, start), chunk, numLanes);
+                    
+                    for (int channel = channels >= 2 ? 2 : 0; channel < channels; ++channel)
+                        renderMono(audioBuffer.getWritePointer(channel, start), rings[(size_t) channel].data(), chunk, numLanes);
+                }
+                
+                writePos = (writePos + chunk) & ringMask;
+            }
+        }
+        
+    private:
+        static constexpr float maxDelaySeconds = 0.05f;
+        
+        // Delay at the start of the chunk and a per-sample slope to where the LFO ends
+        // up, plus per-lane gains (zero for lanes past the active voice count)
+        void updateVoices(int chunk, int extraVoices, int channels) {
+            const float depth = detune * 0.002f * sampleRate;
+            const float gain = 0.7f / std::sqrt((float) voiceCount); // voices add up incoherently
+            const float panScale = channels >= 2 ? juce::MathConstants<float>::sqrt2 : 1.0f;
+            const int numLanes = ((extraVoices + voiceBatchSize - 1) / voiceBatchSize) * voiceBatchSize;
+            
+            for (int v = 0; v < numLanes; ++v) {
+                const float startDelay = baseDelay[(size_t) v] + depth * std::sin(lfoPhase[(size_t) v]);
+                
+                lfoPhase[(size_t) v] += lfoIncrement[(size_t) v] * (float) chunk;
+                if (lfoPhase[(size_t) v] > juce::MathConstants<float>::twoPi)
+                    lfoPhase[(size_t) v] -= juce::MathConstants<float>::twoPi;
+                
+                const float endDelay = baseDelay[(size_t) v] + depth * std::sin(lfoPhase[(size_t) v]);
+                const float laneGain = v < extraVoices ? gain : 0.0f;
+                
+                voiceDelay[(size_t) v] = startDelay;
+                voiceDelayStep[(size_t) v] = (endDelay - startDelay) / (float) chunk;
+                voiceGain[(size_t) v] = laneGain;
+                voiceGainLeft[(size_t) v] = laneGain * panScale * panLeft[(size_t) v];
+                voiceGainRight[(size_t) v] = laneGain * panScale * panRight[(size_t) v];
+            }
+        }
+        
+        void renderStereo(float* left, float* right, int chunk, int numLanes) {
+            const float* ringLeft = rings[0].data();
+            const float* ringRight = rings[1].data();
+            
+            for (int i = 0; i < chunk; ++i) {
+                const int head = writePos + i;
+                alignas(32) float sumLeft[voiceBatchSize] = {};
+                alignas(32) float sumRight[voiceBatchSize] = {};
+                
+                for (int batch = 0; batch < numLanes; batch += voiceBatchSize) {
+                    for (int lane = 0; lane < voiceBatchSize; ++lane) {
+                        const int v = batch + lane;
+                        const float delay = voiceDelay[(size_t) v] + (float) i * voiceDelayStep[(size_t) v];
+                        const int whole = (int) delay;
+                        const float fraction = delay - (float) whole;
+                        const int newer = (head - whole) & ringMask;
+                        const int older = (newer - 1) & ringMask;
+                        
+                        sumLeft[lane] += voiceGainLeft[(size_t) v] * (ringLeft[newer] + fraction * (ringLeft[older] - ringLeft[newer]));
+                        sumRight[lane] += voiceGainRight[(size_t) v] * (ringRight[newer] + fraction * (ringRight[older] - ringRight[newer]));
+                    }
+                }
+                
+                float outLeft = 0.0f, outRight = 0.0f;
+                for (int lane = 0; lane < voiceBatchSize; ++lane) {
+                    outLeft += sumLeft[lane];
+                    outRight += sumRight[lane];
+                }
+                
+                left[i] += outLeft;
+                right[i] += outRight;
+            }
+        }
+        
+        void renderMono(float* channelData, const float* ring, int chunk, int numLanes) {
+            for (int i = 0; i < chunk; ++i) {
+                const int head = writePos + i;
+                alignas(32) float sum[voiceBatchSize] = {};
+                
+                for (int batch = 0; batch < numLanes; batch += voiceBatchSize) {
+                    for (int lane = 0; lane < voiceBatchSize; ++lane) {
+                        const int v = batch + lane;
+                        const float delay = voiceDelay[(size_t) v] + (float) i * voiceDelayStep[(size_t) v];
+                        const int whole = (int) delay;
+                        const float fraction = delay - (float) whole;
+                        const int newer = (head - whole) & ringMask;
+                        const int older = (newer - 1) & ringMask;
+                        
+                        sum[lane] += voiceGain[(size_t) v] * (ring[newer] + fraction * (ring[older] - ring[newer]));
+                    }
+                }
+                
+                float out = 0.0f;
+                for (int lane = 0; lane < voiceBatchSize; ++lane)
+                    out += sum[lane];
+                
+                channelData[i] += out;
+            }
+        }
+        
+        float sampleRate = 44100.0f;
+        int numChannels = 0;
+        int maxBlockSize = 512;
+        
+        std::vector<std::vector<float>> rings;
+        int ringMask = 0;
+        int writePos = 0;
+        
+        int voiceCount = 1;
+        float detune = 0.0f;
+        
+        // Structure-of-arrays voice state, one lane per extra voice
+        alignas(32) std::array<float, maxVoices> baseDelay {};
+        alignas(32) std::array<float, maxVoices> lfoPhase {};
+        alignas(32) std::array<float, maxVoices> lfoIncrement {};
+        alignas(32) std::array<float, maxVoices> panLeft {};
+        alignas(32) std::array<float, maxVoices> panRight {};
+        alignas(32) std::array<float, maxVoices> voiceDelay {};
+        alignas(32) std::array<float, maxVoices> voiceDelayStep {};
+        alignas(32) std::array<float, maxVoices> voiceGain {};
+        alignas(32) std::array<float, maxVoices> voiceGainLeft {};
+        alignas(32) std::array<float, maxVoices> voiceGainRight {};
+    };
+    
+private:
+    PitchTracker pitchTracker;
+    SimpleShifter pitchShifter;
+    SimpleFormantShifter formantShifter;
+    SimpleVoiceMultiplier voiceMultiplier;
+    FdnReverb reverb;
+    ConvolutionReverb convolutionReverb;
+    int activeReverbMode = REVERB_ALGORITHMIC;
+    
+    // High quality path: one STFT feeding both spectral stages
+    StftEngine spectralEngine;
+    SpectralPitchShifter spectralPitchShifter;
+    SpectralFormantShifter spectralFormantShifter;
+    int activeQualityMode = LOW_LATENCY;
+    
+    // Pitch, formant and voice stages on the voice band alone, at a reduced rate (see
+    // VoiceBandSplitter.h). Only in use when it's switched on and the host rate is
+    // 44.1 kHz or more.
+    VoiceBandSplitter voiceBand;
+    juce::AudioBuffer<float> voiceBandBlock;
+    bool activeReducedRate = false;
+    int voiceBandFactor = 1;        // 1 while the stages run at the host rate
+    
+    // Pitch/formant path, at the rate it runs at
+    int getPitchPathLatency() const;
+    
+    // Pitch/formant path plus distortion oversampling, for the active settings
+    int getTotalLatency() const;
+    std::atomic<int> latencySamples { 0 };
+    
+    // Window sizes, overlap, oversampling and reverb partitioning for each latency
+    // profile. They are fixed in prepare(); a new profile needs another prepare().
+    struct ProfileSettings {
+        float lowestPitch;          // Hz, sets the PSOLA and pitch tracker windows
+        int stftOrderOffset;        // relative to the STFT's default FFT size
+        int stftOverlap;
+        int reverbHeadSize;         // first convolution partitions, in samples
+        int oversampling;           // fixed oversampling, or -1 to follow the parameter
+    };
+    
+    static const ProfileSettings& getProfileSettings(int profile);
+    int activeProfile = PROFILE_BROADCAST;
+    int getOversamplingSetting() const;
+    
+    // Skips stages with silent input and state (see IdleDetector.h). The tail
+    // lengths follow the active settings and are reported to the host as well.
+    IdleDetector idleDetector;
+    std::atomic<double> tailLengthSeconds { 0.0 };
+    void updateLatencyAndTail();
+    void updateTailLength();
+    void skipControlRamps(int numSamples);
+    
+    StageProfiler profiler;
+    
+    FdnReverb::Parameters readReverbParameters() const;
+    int getReverbTailInSamples() const;
+    
+    // Character preset values
+    struct CharacterPreset {
+        float pitchShift = 0.0f;
+        float formantShift = 0.5f;
+        int voiceCount = 1;
+        float detune = 0.0f;
+        float reverb = 0.2f;
+        ConvolutionReverb::Room reverbRoom = ConvolutionReverb::room;
+    };
+    
+    std::array<CharacterPreset, NUM_CHARACTERS> characterPresets;
+    void initializeCharacterPresets();
+    
+    // Parameter values the audio thread reads. Each points at this engine's own value
+    // unless it has been bound to one kept elsewhere.
+    std::array<std::atomic<float>, NUM_PARAMETERS> parameterValues;
+    std::array<std::atomic<float>*, NUM_PARAMETERS> parameterSources;
+    
+    float readParameter(EngineParameter parameter) const {
+        return parameterSources[(size_t) parameter]->load(std::memory_order_relaxed);
+    }
+    
+    // Effective settings for the character-dependent stages
+    struct DspTargets {
+        float pitchShift = 0.0f;
+        float formantShift = 0.5f;
+        float voiceCount = 1.0f;
+        float detune = 0.0f;
+        float reverb = 0.2f;
+    };
+    
+    DspTargets readUserTargets() const;
+    
+    // Blends the user's knob values towards the selected character preset by
+    // strength and smooths the result per sample. It never writes to the
+    // parameters, so the user's settings stay untouched and the host isn't notified
+    // from the audio thread.
+    class CharacterMorph {
+    public:
+        void prepare(double sampleRate) {
+            for (auto* smoother : smoothers())
+                smoother->reset(sampleRate, 0.05);
+        }
+        
+        // Jump straight to a state, e.g. when playback (re)starts
+        void reset(const DspTargets& targets) {
+            setTargets(targets);
+            for (auto* smoother : smoothers())
+                smoother->setCurrentAndTargetValue(smoother->getTargetValue());
+        }
+        
+        void setTargets(const DspTargets& user, const CharacterPreset* preset = nullptr, float strength = 0.0f) {
+            auto blend = [strength, preset](float userValue, float presetValue) {
+                return preset != nullptr ? userValue + strength * (presetValue - userValue) : userValue;
+            };
+            
+            const CharacterPreset fallback {};
+            const auto& p = preset != nullptr ? *preset : fallback;
+            
+            pitchShift.setTargetValue(blend(user.pitchShift, p.pitchShift));
+            formantShift.setTargetValue(blend(user.formantShift, p.formantShift));
+            voiceCount.setTargetValue(blend(user.voiceCount, (float) p.voiceCount));
+            detune.setTargetValue(blend(user.detune, p.detune));
+            reverb.setTargetValue(blend(user.reverb, p.reverb));
+        }
+        
+        // Moves the smoothers on by a block and returns where they ended up
+        DspTargets advance(int numSamples) {
+            for (auto* smoother : smoothers())
+                smoother->skip(numSamples);
+            
+            DspTargets current;
+            current.pitchShift = pitchShift.getCurrentValue();
+            current.formantShift = formantShift.getCurrentValue();
+            current.voiceCount = voiceCount.getCurrentValue();
+            current.detune = detune.getCurrentValue();
+            current.reverb = reverb.getCurrentValue();
+            return current;
+        }
+        
+    private:
+        std::array<juce::LinearSmoothedValue<float>*, 5> smoothers() {
+            return { &pitchShift, &formantShift, &voiceCount, &detune, &reverb };
+        }
+        
+        juce::LinearSmoothedValue<float> pitchShift;
+        juce::LinearSmoothedValue<float> formantShift;
+        juce::LinearSmoothedValue<float> voiceCount;
+        juce::LinearSmoothedValue<float> detune;
+        juce::LinearSmoothedValue<float> reverb;
+    };
+    
+    CharacterMorph characterMorph;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VocalTransformerEngine)
+};
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+
+// Half-band lowpass FIRs for halving and doubling the sample rate. Every other tap
+// of a half-band filter is zero apart from the centre one, which is 1/2, so only
+// the side taps either side of the centre are stored:
+//     h[c] = 1/2,  h[c - (2j+1)] = h[c + (2j+1)] = sideTaps[j],  c = 2 * numSideTaps - 1
+// Both resamplers are polyphase. The decimator splits its input into even and odd
+// samples, and the interpolator works out its even and odd outputs separately, so
+// neither touches the zero taps. The loops run over time for one tap at a time,
+// with contiguous loads and a fixed summing order, so they vectorise without
+// fast-math flags. History is kept in front of each block, so no loop wraps.
+namespace HalfBand
+{
+    // Kaiser-windowed sinc. beta 8 gives about 80 dB of stopband rejection.
+    inline std::vector<float> design(int numSideTaps, double beta = 8.0) {
+        auto besselI0 = [](double x) {
+            double sum = 1.0, term = 1.0;
+            for (int k = 1; k < 32; ++k) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        };
+
+        const double halfLength = 2.0 * numSideTaps;
+        std::vector<double> taps((size_t) numSideTaps);
+        double sum = 0.0;
+
+        for (int j = 0; j < numSideTaps; ++j) {
+            const double offset = 2.0 * j + 1.0;
+            const double ratio = offset / halfLength;
+            const double window = besselI0(beta * std::sqrt(1.0 - ratio * ratio)) / besselI0(beta);
+            taps[(size_t) j] = ((j % 2 == 0) ? 1.0 : -1.0) / (juce::MathConstants<double>::pi * offset) * window;
+            sum += taps[(size_t) j];
+        }
+
+        // Scaled for unity gain at DC: the side taps add up to 1/4 on each side
+        std::vector<float> sideTaps((size_t) numSideTaps);
+        for (int j = 0; j < numSideTaps; ++j)
+            sideTaps[(size_t) j] = (float) (taps[(size_t) j] * 0.25 / sum);
+
+        return sideTaps;
+    }
+
+    // One channel. Output sample m is the filtered input at 2m + 1 - c.
+    class Decimator {
+    public:
+        void prepare(const std::vector<float>& newSideTaps, int maxInputSamples) {
+            sideTaps = newSideTaps;
+            history = 2 * (int) sideTaps.size() - 1;
+            even.assign((size_t) (history + maxInputSamples / 2 + 1), 0.0f);
+            odd.assign(even.size(), 0.0f);
+            reset();
+        }
+
+        void reset() {
+            std::fill(even.begin(), even.end(), 0.0f);
+            std::fill(odd.begin(), odd.end(), 0.0f);
+            pending = 0.0f;
+            hasPending = false;
+        }
+
+        // Writes one sample per pair received, counting one left over from last time,
+        // and returns how many
+        int process(const float* input, int numSamples, float* output) {
+            float* e = even.data() + history;
+            float* o = odd.data() + history;
+            int numPairs = 0;
+            int i = 0;
+
+            if (hasPending && numSamples > 0) {
+                e[0] = pending;
+                o[0] = input[0];
+                numPairs = 1;
+                i = 1;
+                hasPending = false;
+            }
+
+            const int newPairs = (numSamples - i) / 2;
+            for (int p = 0; p < newPairs; ++p) {
+                e[numPairs + p] = input[i + 2 * p];
+                o[numPairs + p] = input[i + 2 * p + 1];
+            }
+
+            numPairs += newPairs;
+            i += 2 * newPairs;
+
+            if (i < numSamples) {
+                pending = input[i];
+                hasPending = true;
+            }
+
+            //     y[m] = e[m + 1 - K] / 2 + sum_j sideTaps[j] * (o[m - K - j] + o[m + 1 - K + j])
+            const int k = (int) sideTaps.size();
+            const float* centre = e + 1 - k;
+            for (int m = 0; m < numPairs; ++m)
+                output[m] = 0.5f * centre[m];
+
+            for (int j = 0; j < k; ++j) {
+                const float tap = sideTaps[(size_t) j];
+                const float* before = o - k - j;
+                const float* after = o + 1 - k + j;
+                for (int m = 0; m < numPairs; ++m)
+                    output[m] += tap * (before[m] + after[m]);
+            }
+
+            if (numPairs > 0) {
+                std::copy(even.begin() + numPairs, even.begin() + numPairs + history, even.begin());
+                std::copy(odd.begin() + numPairs, odd.begin() + numPairs + history, odd.begin());
+            }
+
+            return numPairs;
+        }
+
+    private:
+        std::vector<float> sideTaps;
+        std::vector<float> even, odd;   // history, then the block's pairs
+        int history = 0;
+        float pending = 0.0f;
+        bool hasPending = false;
+    };
+
+    // One channel. Output samples 2m and 2m + 1 are written once input m arrives.
+    class Interpolator {
+    public:
+        void prepare(const std::vector<float>& newSideTaps, int maxInputSamples) {
+            // Doubled, since the zeros stuffed in between halve the gain
+            doubledTaps = newSideTaps;
+            for (auto& tap : doubledTaps)
+                tap *= 2.0f;
+
+            history = 2 * (int) doubledTaps.size() - 1;
+            input.assign((size_t) (history + maxInputSamples), 0.0f);
+            evenOutput.assign((size_t) maxInputSamples, 0.0f);
+            reset();
+        }
+
+        void reset() {
+            std::fill(input.begin(), input.end(), 0.0f);
+        }
+
+        // Writes twice as many samples as it receives
+        void process(const float* source, int numSamples, float* output) {
+            float* y = input.data() + history;
+            std::copy(source, source + numSamples, y);
+
+            //     z[2m]     = 2 * sum_j sideTaps[j] * (y[m + 1 - K + j] + y[m - K - j])
+            //     z[2m + 1] = y[m + 1 - K]
+            const int k = (int) doubledTaps.size();
+            std::fill(evenOutput.begin(), evenOutput.begin() + numSamples, 0.0f);
+            float* evens = evenOutput.data();
+
+            for (int j = 0; j < k; ++j) {
+                const float tap = doubledTaps[(size_t) j];
+                const float* after = y + 1 - k + j;
+                const float* before = y - k - j;
+                for (int m = 0; m < numSamples; ++m)
+                    evens[m] += tap * (after[m] + before[m]);
+            }
+
+            const float* centre = y + 1 - k;
+            for (int m = 0; m < numSamples; ++m) {
+                output[2 * m] = evens[m];
+                output[2 * m + 1] = centre[m];
+            }
+
+            if (numSamples > 0)
+                std::copy(input.begin() + numSamples, input.begin() + numSamples + history, input.begin());
+        }
+
+    private:
+        std::vector<float> doubledTaps;
+        std::vector<float> input;       // history, then the block
+        std::vector<float> evenOutput;
+        int history = 0;
+    };
+}
+
+// Splits the signal into the voice band, at a reduced internal rate, and the air
+// band above it, at the host rate. The sample rate is halved until it's the lowest
+// at or above 22.05 kHz, so the voice band keeps everything up to about 10 kHz.
+// The last halving needs a sharp filter; the earlier ones, with the whole octave
+// above the voice band to fall off in, get by with short ones.
+//
+// The air band is the input less the voice band as it comes back through the
+// same filters unprocessed, so with nothing done to the voice band the two add up
+// to the input, delayed. The voice band's own stages add latency at the internal
+// rate; the unprocessed copy and the air band are delayed to match, so the bands
+// stay aligned.
+//
+// Blocks of any length are split. The internal rate sees half of them, rounded
+// down, per halving, which the output makes up for with a FIFO that starts with
+// factor - 1 samples of silence. Everything is allocated in prepare().
+class VoiceBandSplitter {
+public:
+    static constexpr double lowestInternalRate = 22050.0;
+    static constexpr int sharpSideTaps = 16;    // last halving: 10 kHz passes, 14 kHz is down 80 dB
+    static constexpr int shortSideTaps = 5;     // earlier halvings
+
+    // 1 when the host rate is already low enough
+    static int getFactorForRate(double sampleRate) {
+        int factor = 1;
+        while (sampleRate / (2 * factor) >= lowestInternalRate)
+            factor *= 2;
+        return factor;
+    }
+
+    // maxBlockSize is the most split() is given at once; maxVoiceBandLatency is the
+    // most the voice band's stages will add, at the internal rate
+    void prepare(double sampleRate, int maxBlockSize, int newNumChannels, int maxVoiceBandLatency) {
+        factor = getFactorForRate(sampleRate);
+        numChannels = juce::jmax(1, newNumChannels);
+        maxBlock = juce::jmax(1, maxBlockSize);
+        maxLowLatency = juce::jmax(0, maxVoiceBandLatency);
+        voiceBandLatency = 0;
+
+        int numStages = 0;
+        while ((1 << numStages) < factor)
+            ++numStages;
+
+        // Delay through the chain of halvings and doublings, in host samples: stage s
+        // (from 0) runs at 1/2^s of the host rate, and each filter delays by its centre
+        resamplingLatency = factor - 1;
+        for (int stage = 0; stage < numStages; ++stage) {
+            const int centre = 2 * getSideTaps(stage, numStages) - 1;
+            resamplingLatency += (1 << stage) * (2 * centre - 1);
+        }
+
+        const int maxInternal = getMaxInternalBlockSize();
+        const int fifoSize = maxBlock + 2 * factor;
+
+        channels.resize((size_t) numChannels);
+        for (auto& channel : channels) {
+            channel.decimators.resize((size_t) numStages);
+            channel.interpolators.resize((size_t) numStages);
+            channel.referenceInterpolators.resize((size_t) numStages);
+
+            for (int stage = 0; stage < numStages; ++stage) {
+                const auto taps = HalfBand::design(getSideTaps(stage, numStages));
+                const int stageInput = maxBlock / (1 << stage) + 1;
+                channel.decimators[(size_t) stage].prepare(taps, stageInput);
+                channel.interpolators[(size_t) stage].prepare(taps, stageInput / 2 + 1);
+                channel.referenceInterpolators[(size_t) stage].prepare(taps, stageInput / 2 + 1);
+            }
+
+            channel.inputDelay.assign((size_t) (resamplingLatency + factor * maxLowLatency + maxBlock + 1), 0.0f);
+            channel.referenceDelay.assign((size_t) (maxLowLatency + maxInternal + 1), 0.0f);
+            channel.fifo.assign((size_t) fifoSize, 0.0f);
+            channel.referenceFifo.assign((size_t) fifoSize, 0.0f);
+            channel.airBand.assign((size_t) maxBlock, 0.0f);
+        }
+
+        scratchA.assign((size_t) fifoSize, 0.0f);
+        scratchB.assign((size_t) fifoSize, 0.0f);
+        delayedVoiceBand.assign((size_t) maxInternal, 0.0f);
+        reset();
+    }
+
+    void reset() {
+        for (auto& channel : channels) {
+            for (auto& decimator : channel.decimators)
+                decimator.reset();
+            for (auto& interpolator : channel.interpolators)
+                interpolator.reset();
+            for (auto& interpolator : channel.referenceInterpolators)
+                interpolator.reset();
+
+            std::fill(channel.inputDelay.begin(), channel.inputDelay.end(), 0.0f);
+            std::fill(channel.referenceDelay.begin(), channel.referenceDelay.end(), 0.0f);
+            channel.inputDelayPosition = 0;
+            channel.referenceDelayPosition = 0;
+
+            // Primed so a whole block can always be read back
+            std::fill(channel.fifo.begin(), channel.fifo.end(), 0.0f);
+            std::fill(channel.referenceFifo.begin(), channel.referenceFifo.end(), 0.0f);
+            channel.fifoCount = factor - 1;
+            channel.referenceFifoCount = factor - 1;
+        }
+    }
+
+    bool isActive() const { return factor > 1; }
+    int getFactor() const { return factor; }
+    int getMaxInternalBlockSize() const { return maxBlock / factor + 1; }
+
+    // What the voice band's stages currently add, at the internal rate
+    void setVoiceBandLatency(int numSamples) {
+        voiceBandLatency = juce::jlimit(0, maxLowLatency, numSamples);
+    }
+
+    // Through the filters alone, in host samples
+    int getResamplingLatency() const { return resamplingLatency; }
+
+    // Both bands, including the voice band's stages, in host samples
+    int getLatencyInSamples() const { return resamplingLatency + factor * voiceBandLatency; }
+
+    // Writes the voice band at the internal rate into voiceBand and returns how many
+    // samples. The air band is kept for combine().
+    int split(const juce::AudioBuffer<float>& block, juce::AudioBuffer<float>& voiceBand) {
+        jassert(isActive());
+        const int numSamples = block.getNumSamples();
+        int numInternal = 0;
+
+        for (int c = 0; c < numChannels; ++c) {
+            auto& channel = channels[(size_t) c];
+            const float* input = block.getReadPointer(juce::jmin(c, block.getNumChannels() - 1));
+
+            // Halvings, ending in the voice band buffer
+            const float* source = input;
+            int count = numSamples;
+            for (size_t stage = 0; stage < channel.decimators.size(); ++stage) {
+                const bool last = stage + 1 == channel.decimators.size();
+                float* destination = last ? voiceBand.getWritePointer(c) : (stage % 2 == 0 ? scratchA.data() : scratchB.data());
+                count = channel.decimators[stage].process(source, count, destination);
+                source = destination;
+            }
+
+            numInternal = count;
+
+            // The unprocessed voice band, delayed as the stages will delay it, back at the
+            // host rate. The air band is what it leaves of the input.
+            delayInternal(channel, voiceBand.getReadPointer(c), numInternal, delayedVoiceBand.data());
+            interpolate(channel.referenceInterpolators, delayedVoiceBand.data(), numInternal, channel.referenceFifo, channel.referenceFifoCount);
+
+            const int inputDelay = getLatencyInSamples();
+            const int delaySize = (int) channel.inputDelay.size();
+            for (int i = 0; i < numSamples; ++i) {
+                channel.inputDelay[(size_t) channel.inputDelayPosition] = input[i];
+                const int readPosition = (channel.inputDelayPosition - inputDelay + delaySize) % delaySize;
+                channel.airBand[(size_t) i] = channel.inputDelay[(size_t) readPosition] - channel.referenceFifo[(size_t) i];
+                channel.inputDelayPosition = (channel.inputDelayPosition + 1) % delaySize;
+            }
+
+            popFifo(channel.referenceFifo, channel.referenceFifoCount, numSamples);
+        }
+
+        lastBlockSize = numSamples;
+        return numInternal;
+    }
+
+    // Replaces the block from split() with the processed voice band, back at the host
+    // rate, plus the air band
+    void combine(const juce::AudioBuffer<float>& voiceBand, int numInternalSamples, juce::AudioBuffer<float>& block) {
+        jassert(block.getNumSamples() == lastBlockSize);
+
+        for (int c = 0; c < juce::jmin(numChannels, block.getNumChannels()); ++c) {
+            auto& channel = channels[(size_t) c];
+            interpolate(channel.interpolators, voiceBand.getReadPointer(c), numInternalSamples, channel.fifo, channel.fifoCount);
+
+            float* output = block.getWritePointer(c);
+            const float* voice = channel.fifo.data();
+            const float* air = channel.airBand.data();
+            for (int i = 0; i < lastBlockSize; ++i)
+                output[i] = voice[i] + air[i];
+
+            popFifo(channel.fifo, channel.fifoCount, lastBlockSize);
+        }
+    }
+
+private:
+    struct Channel {
+        std::vector<HalfBand::Decimator> decimators;
+        std::vector<HalfBand::Interpolator> interpolators;
+        std::vector<HalfBand::Interpolator> referenceInterpolators;
+
+        std::vector<float> inputDelay;          // host rate, feeds the air band
+        int inputDelayPosition = 0;
+        std::vector<float> referenceDelay;      // internal rate, matches the stages
+        int referenceDelayPosition = 0;
+
+        // Host-rate output of the doublings, oldest first
+        std::vector<float> fifo, referenceFifo;
+        int fifoCount = 0, referenceFifoCount = 0;
+
+        std::vector<float> airBand;
+    };
+
+    static int getSideTaps(int stage, int numStages) {
+        return stage == numStages - 1 ? sharpSideTaps : shortSideTaps;
+    }
+
+    void delayInternal(Channel& channel, const float* input, int numSamples, float* output) const {
+        const int delaySize = (int) channel.referenceDelay.size();
+        for (int i = 0; i < numSamples; ++i) {
+            channel.referenceDelay[(size_t) channel.referenceDelayPosition] = input[i];
+            output[i] = channel.referenceDelay[(size_t) ((channel.referenceDelayPosition - voiceBandLatency + delaySize) % delaySize)];
+            channel.referenceDelayPosition = (channel.referenceDelayPosition + 1) % delaySize;
+        }
+    }
+
+    // Doublings from the internal rate, appended to the FIFO
+    void interpolate(std::vector<HalfBand::Interpolator>& interpolators, const float* input, int numSamples,
+                     std::vector<float>& fifo, int& fifoCount) {
+        if (interpolators.empty() || numSamples <= 0)
+            return;
+
+        const float* source = input;
+        int count = numSamples;
+        for (size_t stage = interpolators.size(); stage-- > 0;) {
+            float* destination = stage == 0 ? fifo.data() + fifoCount : (stage % 2 == 0 ? scratchA.data() : scratchB.data());
+            interpolators[stage].process(source, count, destination);
+            source = destination;
+            count *= 2;
+        }
+
+        fifoCount += count;
+    }
+
+    static void popFifo(std::vector<float>& fifo, int& fifoCount, int numSamples) {
+        std::copy(fifo.begin() + numSamples, fifo.begin() + fifoCount, fifo.begin());
+        fifoCount -= numSamples;
+    }
+
+    int factor = 1;
+    int numChannels = 0;
+    int maxBlock = 0;
+    int maxLowLatency = 0;
+    int voiceBandLatency = 0;
+    int resamplingLatency = 0;
+    int lastBlockSize = 0;
+
+    std::vector<Channel> channels;
+    std::vector<float> scratchA, scratchB;     // between halvings or doublings
+    std::vector<float> delayedVoiceBand;
+};